@@ -0,0 +1,496 @@
+// Headless benchmark of the DSP: no host, synthetic MIDI, several block sizes and sample rates.
+// usage: simon-bench [output.csv] [seconds of audio per configuration]
+// One CSV line per benchmark and configuration:
+// - process, game: whole blocks without input, respectively waiting and during instructions. ns per block, per sample, worst block.
+// - noteOn, noteOff: blocks with incoming notes, cost per event is on top of an idle block. worst block.
+// - addNote, shiftNote: what is behind, drawing a note and shifting a note from the player, per call. worst per call over chunks of calls.
+// - addMelodic, buildMelodic: same draw with the melodic generator (one note after the other), and building its tables between games, per call.
+// - saveState, loadState: session state as saved and loaded by the host, largest one (every player, full sequences), per call.
+// - restore: the block applying a loaded state, on top of an idle block. worst block.
+// - loadMelody: MIDI file of the melody mode as loaded by the host (mapping and parsing), every track full of notes, per call.
+// - synth1, synth8, synth32: built-in synth alone with that many voices sounding, per block and per sample. CPU per voice is printed.
+// - pitch2ms, pitch5ms...: whole blocks listening to tones of the synth on audio input, with that detection hop. Latency from tone to note and accuracy are printed.
+
+#include "SimonHost.h"
+#include "SimonLayout.h"
+#include "SimonState.h"
+#include "SimonMelody.h"
+#include "SimonSynth.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+USE_NAMESPACE_DISTRHO
+
+// incoming notes in each block for noteOn / noteOff
+#define BENCH_NOTES_PER_BLOCK 8
+// calls between two clock reads for functions too fast to be measured alone
+#define BENCH_CHUNK 1024
+// size of the MIDI file for loadMelody, in notes per track
+#define BENCH_MELODY_NOTES 4096
+// block size for the synth, and sample rates it is measured at
+#define BENCH_SYNTH_BLOCK 256
+// audio input: sample rate, tones from lowest note by steps of semitones, in ms sounding then silence
+#define BENCH_PITCH_RATE 48000
+#define BENCH_PITCH_LOW 36
+#define BENCH_PITCH_STEP 5
+#define BENCH_PITCH_NB_TONES 13
+#define BENCH_PITCH_TONE_MS 300
+#define BENCH_PITCH_SILENCE_MS 200
+
+static const uint32_t blockSizes[] = {16, 64, 256, 1024, 4096};
+static const double sampleRates[] = {44100, 48000, 96000};
+static const double synthRates[] = {48000, 96000};
+static const int synthVoices[] = {1, 8, SYNTH_MAX_VOICES};
+static const int pitchHops[] = {2, 5, 10, 20};
+
+static uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// accumulate durations
+struct Timing {
+  uint64_t count = 0;
+  uint64_t total = 0;
+  uint64_t worst = 0;
+
+  void add(uint64_t ns) {
+    count++;
+    total += ns;
+    if (ns > worst) {
+      worst = ns;
+    }
+  }
+
+  double mean() const {
+    return count > 0 ? (double) total / count : 0;
+  }
+};
+
+// output both to file and to console
+class Report {
+
+ public:
+  Report(const char *path) {
+    file = fopen(path, "w");
+    if (file == nullptr) {
+      fprintf(stderr, "cannot open %s, only printing results\n", path);
+    }
+    else {
+      fprintf(file, "benchmark,sample_rate,block_size,calls,ns_per_call,ns_per_sample,worst_ns\n");
+    }
+    printf("%-10s %8s %6s %10s %12s %12s %12s\n", "benchmark", "rate", "block", "calls", "ns/call", "ns/sample", "worst ns");
+  }
+
+  ~Report() {
+    if (file != nullptr) {
+      fclose(file);
+    }
+  }
+
+  // sample rate and block size are 0 for functions outside of processing
+  void add(const char *name, double sampleRate, uint32_t blockSize, uint64_t calls, double nsPerCall, double nsPerSample, double worstNs) {
+    if (file != nullptr) {
+      fprintf(file, "%s,%.0f,%u,%llu,%.3f,%.3f,%.0f\n", name, sampleRate, blockSize, (unsigned long long) calls, nsPerCall, nsPerSample, worstNs);
+    }
+    printf("%-10s %8.0f %6u %10llu %12.3f %12.3f %12.0f\n", name, sampleRate, blockSize, (unsigned long long) calls, nsPerCall, nsPerSample, worstNs);
+  }
+
+ private:
+  FILE *file = nullptr;
+};
+
+// blocks with nothing to do besides waiting for the game to start
+static Timing benchIdle(SimonHost &host, uint64_t nbBlocks) {
+  Timing timing;
+  for (uint64_t b = 0; b < nbBlocks; b++) {
+    const uint64_t start = nowNs();
+    host.run(host.getBufferSize());
+    timing.add(nowNs() - start);
+  }
+  return timing;
+}
+
+// notes spread over the block, alternating blocks with note on and blocks with note off
+static void benchNotes(SimonHost &host, uint64_t nbBlocks, Timing &on, Timing &off) {
+  const uint32_t bufferSize = host.getBufferSize();
+  for (uint64_t b = 0; b < nbBlocks; b++) {
+    const bool noteOn = b % 2 == 0;
+    for (uint32_t i = 0; i < BENCH_NOTES_PER_BLOCK; i++) {
+      // cycle over two octaves, within and outside of default layout
+      const uint8_t note = 48 + (i + (b / 2) * BENCH_NOTES_PER_BLOCK) % 24;
+      const uint32_t frame = i * bufferSize / BENCH_NOTES_PER_BLOCK;
+      if (noteOn) {
+        host.noteOn(note, 100, 0, frame);
+      }
+      else {
+        host.noteOff(note, 0, frame);
+      }
+    }
+    const uint64_t start = nowNs();
+    host.run(bufferSize);
+    (noteOn ? on : off).add(nowNs() - start);
+  }
+}
+
+// new games over and over, until player's turn: game start, drawing notes, instructions
+static Timing benchGame(SimonHost &host, uint64_t nbBlocks, uint64_t &nbGames) {
+  Timing timing;
+  nbGames = 0;
+  host.setParameter(kStart, 0);
+  host.run(host.getBufferSize());
+  for (uint64_t b = 0; b < nbBlocks; b++) {
+    const int status = host.getParameter(kStatus);
+    if (!isRunning(status) || isPlaying(status)) {
+      // toggle start, will be applied at the beginning of the block
+      if (host.getParameter(kStart) > 0) {
+        host.setParameter(kStart, 0);
+      }
+      else {
+        host.setParameter(kStart, 1);
+        nbGames++;
+      }
+    }
+    const uint64_t start = nowNs();
+    host.run(host.getBufferSize());
+    timing.add(nowNs() - start);
+  }
+  host.setParameter(kStart, 0);
+  host.run(host.getBufferSize());
+  return timing;
+}
+
+static void benchProcess(Report &report, double sampleRate, uint32_t blockSize, double seconds) {
+  SimonHost host(sampleRate, blockSize);
+  uint64_t nbBlocks = seconds * sampleRate / blockSize;
+  if (nbBlocks < 2) {
+    nbBlocks = 2;
+  }
+  // warm-up caches and apply initial parameters
+  benchIdle(host, nbBlocks / 10 + 1);
+
+  Timing idle = benchIdle(host, nbBlocks);
+  report.add("process", sampleRate, blockSize, idle.count, idle.mean(), idle.mean() / blockSize, idle.worst);
+
+  uint64_t nbGames;
+  Timing game = benchGame(host, nbBlocks, nbGames);
+  report.add("game", sampleRate, blockSize, game.count, game.mean(), game.mean() / blockSize, game.worst);
+
+  Timing on, off;
+  benchNotes(host, nbBlocks, on, off);
+  // events cost on top of a block without events
+  double onCost = (on.mean() - idle.mean()) / BENCH_NOTES_PER_BLOCK;
+  double offCost = (off.mean() - idle.mean()) / BENCH_NOTES_PER_BLOCK;
+  report.add("noteOn", sampleRate, blockSize, on.count * BENCH_NOTES_PER_BLOCK, onCost > 0 ? onCost : 0, on.mean() / blockSize, on.worst);
+  report.add("noteOff", sampleRate, blockSize, off.count * BENCH_NOTES_PER_BLOCK, offCost > 0 ? offCost : 0, off.mean() / blockSize, off.worst);
+
+  if (host.getNbDropped() > 0) {
+    fprintf(stderr, "warning: %u MIDI events from the plugin did not fit in host buffer\n", host.getNbDropped());
+  }
+}
+
+// layout behind addNote() and noteOn(), full piano
+static void benchLayout(Report &report, uint64_t nbCalls) {
+  const int scale[12] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+  NoteLayout layout;
+  layout.update(21, 88, scale);
+  Rando ran;
+  ran.srand(42);
+  const uint64_t nbChunks = nbCalls / BENCH_CHUNK + 1;
+  // prevent the compiler from discarding the calls
+  volatile int sink = 0;
+
+  Timing draw;
+  for (uint64_t c = 0; c < nbChunks; c++) {
+    int acc = 0;
+    const uint64_t start = nowNs();
+    for (uint32_t i = 0; i < BENCH_CHUNK; i++) {
+      acc += layout.draw(ran);
+    }
+    draw.add(nowNs() - start);
+    sink = sink + acc;
+  }
+  report.add("addNote", 0, 0, draw.count * BENCH_CHUNK, draw.mean() / BENCH_CHUNK, 0, (double) draw.worst / BENCH_CHUNK);
+
+  Timing shift;
+  for (uint64_t c = 0; c < nbChunks; c++) {
+    int acc = 0;
+    const uint64_t start = nowNs();
+    for (uint32_t i = 0; i < BENCH_CHUNK; i++) {
+      acc += layout.remapNoteOn((uint8_t) (i + sink));
+    }
+    shift.add(nowNs() - start);
+    sink = sink + acc;
+  }
+  report.add("shiftNote", 0, 0, shift.count * BENCH_CHUNK, shift.mean() / BENCH_CHUNK, 0, (double) shift.worst / BENCH_CHUNK);
+
+  GeneratorSettings melodic;
+  melodic.type = GEN_MELODIC;
+  layout.setGenerator(melodic);
+  Timing chained;
+  int previous = -1;
+  for (uint64_t c = 0; c < nbChunks; c++) {
+    int acc = 0;
+    const uint64_t start = nowNs();
+    for (uint32_t i = 0; i < BENCH_CHUNK; i++) {
+      previous = layout.drawNext(previous, ran);
+      acc += previous;
+    }
+    chained.add(nowNs() - start);
+    sink = sink + acc;
+  }
+  report.add("addMelodic", 0, 0, chained.count * BENCH_CHUNK, chained.mean() / BENCH_CHUNK, 0, (double) chained.worst / BENCH_CHUNK);
+
+  // every candidate against every other, alternating settings so that each call rebuilds
+  Timing build;
+  const uint64_t nbBuilds = nbCalls / BENCH_CHUNK + 1;
+  for (uint64_t i = 0; i < nbBuilds; i++) {
+    melodic.maxLeap = 11 + i % 2;
+    const uint64_t start = nowNs();
+    layout.setGenerator(melodic);
+    build.add(nowNs() - start);
+  }
+  sink = sink + layout.drawNext(previous, ran);
+  report.add("buildMelodic", 0, 0, build.count, build.mean(), 0, build.worst);
+}
+
+// host side of the state, and its cost on the audio thread once loaded
+static void benchState(Report &report, uint64_t nbCalls) {
+  SimonHost host(48000, 256);
+  // largest session: every player in a game, all notes drawn upfront
+  host.setParameter(kLanes, MAX_LANES);
+  host.setParameter(kPregenerate, 1);
+  host.setParameter(kEndless, 1);
+  host.run(host.getBufferSize());
+  host.setParameter(kStart, 1);
+  benchIdle(host, 100);
+
+  Timing save;
+  String state;
+  for (uint64_t i = 0; i < nbCalls; i++) {
+    const uint64_t start = nowNs();
+    state = host.getState(STATE_KEY);
+    save.add(nowNs() - start);
+  }
+  report.add("saveState", 0, 0, save.count, save.mean(), 0, save.worst);
+
+  Timing load;
+  Timing restore;
+  Timing idle;
+  for (uint64_t i = 0; i < nbCalls; i++) {
+    uint64_t start = nowNs();
+    host.setState(STATE_KEY, state);
+    load.add(nowNs() - start);
+    start = nowNs();
+    host.run(host.getBufferSize());
+    restore.add(nowNs() - start);
+    start = nowNs();
+    host.run(host.getBufferSize());
+    idle.add(nowNs() - start);
+  }
+  report.add("loadState", 0, 0, load.count, load.mean(), 0, load.worst);
+  const double restoreCost = restore.mean() - idle.mean();
+  report.add("restore", 48000, host.getBufferSize(), restore.count, restoreCost > 0 ? restoreCost : 0, restore.mean() / host.getBufferSize(), restore.worst);
+  printf("state: %u characters\n", (unsigned int) state.length());
+}
+
+// variable-length quantity of MIDI files
+static void appendVlq(std::string &out, uint32_t value) {
+  char bytes[4];
+  int nbBytes = 0;
+  do {
+    bytes[nbBytes] = (value & 0x7F) | (nbBytes > 0 ? 0x80 : 0);
+    value >>= 7;
+    nbBytes++;
+  } while (value > 0);
+  while (nbBytes > 0) {
+    out += bytes[--nbBytes];
+  }
+}
+
+static void appendU32(std::string &out, uint32_t value) {
+  out += (char) (value >> 24);
+  out += (char) (value >> 16);
+  out += (char) (value >> 8);
+  out += (char) value;
+}
+
+static void benchMelody(Report &report, uint64_t nbCalls) {
+  // one track per channel, chords and running status, written to a temporary file
+  std::string midi("MThd");
+  appendU32(midi, 6);
+  midi += std::string("\0\1\0\x10\x01\xE0", 6);
+  Rando ran;
+  ran.srand(42);
+  for (int track = 0; track < MELODY_MAX_TRACKS; track++) {
+    std::string events;
+    events += '\0';
+    events += (char) (0x90 | track);
+    for (int i = 0; i < BENCH_MELODY_NOTES; i++) {
+      const char note = 36 + ran.bounded(60);
+      events += note;
+      events += (char) 100;
+      appendVlq(events, 120);
+      events += note;
+      events += '\0';
+      appendVlq(events, ran.bounded(2) * 120);
+    }
+    events += std::string("\xFF\x2F\0", 3);
+    midi += "MTrk";
+    appendU32(midi, events.size());
+    midi += events;
+  }
+  char path[] = "/tmp/simon-bench-XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0 || write(fd, midi.data(), midi.size()) != (ssize_t) midi.size()) {
+    fprintf(stderr, "cannot write %s, skipping loadMelody\n", path);
+    return;
+  }
+  close(fd);
+
+  SimonHost host(48000, 256);
+  Timing load;
+  for (uint64_t i = 0; i < nbCalls; i++) {
+    const uint64_t start = nowNs();
+    host.setState(MELODY_KEY, path);
+    load.add(nowNs() - start);
+  }
+  report.add("loadMelody", 0, 0, load.count, load.mean(), 0, load.worst);
+  host.setParameter(kMelody, 1);
+  host.run(host.getBufferSize());
+  printf("melody: %u bytes, %d events, %d notes in use\n", (unsigned int) midi.size(), MELODY_MAX_TRACKS * BENCH_MELODY_NOTES * 2, (int) host.getParameter(kMelodyLength));
+  unlink(path);
+}
+
+// voices struck again every half second so that none fades out, note on is part of the block as with the plugin
+static void benchSynth(Report &report, double sampleRate, double seconds) {
+  std::vector<float> out(BENCH_SYNTH_BLOCK);
+  const uint64_t nbBlocks = seconds * sampleRate / BENCH_SYNTH_BLOCK + 1;
+  const uint64_t strikeEvery = 0.5 * sampleRate / BENCH_SYNTH_BLOCK + 1;
+  for (int nbVoices : synthVoices) {
+    Synth synth;
+    synth.setSampleRate(sampleRate);
+    Timing timing;
+    // first blocks as warm-up
+    for (uint64_t b = 0; b < nbBlocks + nbBlocks / 10; b++) {
+      const uint64_t start = nowNs();
+      synth.beginBlock(out.data(), BENCH_SYNTH_BLOCK);
+      if (b % strikeEvery == 0) {
+        for (int v = 0; v < nbVoices; v++) {
+          synth.noteOn(36 + 2 * v, 100, 0, v % BENCH_SYNTH_BLOCK);
+        }
+      }
+      synth.endBlock();
+      if (b >= nbBlocks / 10) {
+        timing.add(nowNs() - start);
+      }
+    }
+    char name[16];
+    snprintf(name, sizeof(name), "synth%d", nbVoices);
+    report.add(name, sampleRate, BENCH_SYNTH_BLOCK, timing.count, timing.mean(), timing.mean() / BENCH_SYNTH_BLOCK, timing.worst);
+    if (nbVoices == SYNTH_MAX_VOICES) {
+      // ns per second of audio, as a share of one core
+      printf("synth: %.4f%% of a core per voice at %.0f Hz\n", timing.mean() / BENCH_SYNTH_BLOCK / nbVoices * sampleRate / 1e7, sampleRate);
+    }
+  }
+}
+
+// tones of the synth as audio input, one after the other, notes played back while waiting for a game
+// latency is from the start of a tone to the first note on sent for it, right if that note is the tone
+static void benchPitch(Report &report, double seconds) {
+  const uint32_t toneFrames = BENCH_PITCH_TONE_MS * BENCH_PITCH_RATE / 1000;
+  const uint32_t period = toneFrames + BENCH_PITCH_SILENCE_MS * BENCH_PITCH_RATE / 1000;
+  // at least each tone once, only whole tones
+  uint64_t nbPeriods = seconds * BENCH_PITCH_RATE / period;
+  if (nbPeriods < BENCH_PITCH_NB_TONES) {
+    nbPeriods = BENCH_PITCH_NB_TONES;
+  }
+  const uint64_t nbBlocks = (nbPeriods * period + BENCH_SYNTH_BLOCK - 1) / BENCH_SYNTH_BLOCK;
+  for (int hop : pitchHops) {
+    SimonHost host(BENCH_PITCH_RATE, BENCH_SYNTH_BLOCK);
+    // whole piano, every note as is
+    host.setParameter(kRoot, 21);
+    host.setParameter(kNbNotes, 88);
+    for (int p = kScaleC; p <= kScaleB; p++) {
+      host.setParameter(p, 1);
+    }
+    host.setParameter(kAudioInput, 1);
+    host.setParameter(kAudioHop, hop);
+    Synth synth;
+    synth.setSampleRate(BENCH_PITCH_RATE);
+    Timing timing;
+    Timing latency;
+    uint32_t nbTones = 0;
+    uint32_t nbRight = 0;
+    uint32_t nbWrong = 0;
+    // current tone: its note, frame it started, whether a note was sent for it yet
+    int tone = -1;
+    uint64_t toneStart = 0;
+    bool found = false;
+    for (uint64_t b = 0; b < nbBlocks; b++) {
+      const uint64_t blockStart = host.getFrame();
+      synth.beginBlock(host.getInput(0), BENCH_SYNTH_BLOCK);
+      for (uint32_t i = 0; i < BENCH_SYNTH_BLOCK; i++) {
+        const uint64_t frame = blockStart + i;
+        if (frame % period == 0 && frame < nbPeriods * period) {
+          tone = BENCH_PITCH_LOW + BENCH_PITCH_STEP * (nbTones++ % BENCH_PITCH_NB_TONES);
+          toneStart = frame;
+          found = false;
+          synth.noteOn(tone, 100, 0, i);
+        }
+        else if (frame % period == toneFrames) {
+          synth.noteOff(tone, 0, i);
+        }
+      }
+      synth.endBlock();
+      const uint64_t start = nowNs();
+      host.run(BENCH_SYNTH_BLOCK);
+      timing.add(nowNs() - start);
+      for (uint32_t e = 0; e < host.getNbOutput(); e++) {
+        const MidiEvent &event = host.getOutput(e);
+        if ((event.data[0] & 0xF0) != 0x90 || event.data[2] == 0) {
+          continue;
+        }
+        if (!found && event.data[1] == tone) {
+          found = true;
+          nbRight++;
+          latency.add(blockStart + event.frame - toneStart);
+        }
+        else if (event.data[1] != tone) {
+          nbWrong++;
+        }
+      }
+    }
+    char name[16];
+    snprintf(name, sizeof(name), "pitch%dms", hop);
+    report.add(name, BENCH_PITCH_RATE, BENCH_SYNTH_BLOCK, timing.count, timing.mean(), timing.mean() / BENCH_SYNTH_BLOCK, timing.worst);
+    printf("pitch: hop %d ms, latency %.1f ms mean, %.1f ms worst, %u/%u tones found, %u wrong notes\n", hop, latency.mean() * 1000 / BENCH_PITCH_RATE, latency.worst * 1000.0 / BENCH_PITCH_RATE, nbRight, nbTones, nbWrong);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : "simon-bench.csv";
+  const double seconds = argc > 2 ? atof(argv[2]) : 10;
+  if (seconds <= 0) {
+    fprintf(stderr, "usage: %s [output.csv] [seconds of audio per configuration]\n", argv[0]);
+    return 1;
+  }
+
+  Report report(path);
+  for (double sampleRate : sampleRates) {
+    for (uint32_t blockSize : blockSizes) {
+      benchProcess(report, sampleRate, blockSize, seconds);
+    }
+  }
+  benchLayout(report, seconds * 1000000);
+  benchState(report, seconds * 10000);
+  benchMelody(report, seconds * 10);
+  for (double sampleRate : synthRates) {
+    benchSynth(report, sampleRate, seconds);
+  }
+  benchPitch(report, seconds);
+  return 0;
+}
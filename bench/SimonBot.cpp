@@ -0,0 +1,366 @@
+// Bot player: plays full games against the DSP, as fast as the CPU allows.
+// Learns instructions through the event stream, answers with note on / note off after a reaction time, with a given error rate.
+// usage: simon-bot [-g games] [-e error rate] [-r reaction ms] [-d note duration ms] [-b block size] [-s sample rate] [-m rounds for miss] [-S seed] [-E rounds in endless mode] [-t host tempo] [-R rhythm error ms] [-T rhythm tolerance ms] [-o output.csv]
+// Also the workload for profile-guided optimization, see bench/Makefile.
+
+#include "SimonHost.h"
+#include "SimonUtils.h"
+#include "SimonEvents.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+USE_NAMESPACE_DISTRHO
+
+// how the bot behaves, and how the game is set
+struct BotSettings {
+  uint64_t nbGames = 10;
+  // probability to play a wrong note
+  double errorRate = 0;
+  // delay before each note, after the end of the previous one or of the instructions
+  double reactionMs = 150;
+  // how long each note is held
+  double durationMs = 100;
+  uint32_t blockSize = 4096;
+  double sampleRate = 48000;
+  int roundsForMiss = params[kRoundsForMiss].def;
+  // same game each time if not 0
+  int seed = 0;
+  // endless mode if not 0, game stopped after that many rounds
+  uint64_t endlessRounds = 0;
+  // instructions synced to a rolling transport at this tempo if not 0
+  double tempo = 0;
+  // if >= 0 follow the rhythm of instructions, with up to that many ms of error for each note
+  double rhythmMs = -1;
+  // rhythm errors beyond that are a miss, 0 to only score
+  int tolerance = 0;
+  const char *output = nullptr;
+};
+
+// what happened during all games
+struct BotStats {
+  uint64_t nbGames = 0;
+  uint64_t minRound = UINT64_MAX;
+  uint64_t maxRound = 0;
+  uint64_t sumRounds = 0;
+  uint64_t notesPlayed = 0;
+  uint64_t wrongNotes = 0;
+  uint64_t misses = 0;
+  // timing error reported by the plugin at the end of each round, in ms
+  uint64_t timedRounds = 0;
+  double sumTimingMean = 0;
+  double sumTimingJitter = 0;
+  uint64_t midiIn = 0;
+  uint64_t midiOut = 0;
+  uint64_t gameEvents = 0;
+  uint64_t blocks = 0;
+  uint64_t frames = 0;
+  double seconds = 0;
+};
+
+class Bot {
+
+ public:
+  Bot(const BotSettings &settings) : settings(settings), host(settings.sampleRate, settings.blockSize) {
+    reactionFrames = settings.reactionMs * settings.sampleRate / 1000;
+    durationFrames = settings.durationMs * settings.sampleRate / 1000;
+    if (durationFrames < 1) {
+      durationFrames = 1;
+    }
+    ran.srand(1);
+    host.setParameter(kRoundsForMiss, settings.roundsForMiss);
+    host.setParameter(kSeed, settings.seed);
+    host.setParameter(kEndless, settings.endlessRounds > 0);
+    host.setParameter(kTempoSync, settings.tempo > 0);
+    host.setTempo(settings.tempo);
+    host.setParameter(kTolerance, settings.tolerance);
+    learned.reserve(settings.endlessRounds > MAX_ROUND ? settings.endlessRounds : MAX_ROUND);
+    learnedFrames.reserve(learned.capacity());
+    rhythmFrames = settings.rhythmMs * settings.sampleRate / 1000;
+    // let the plugin apply its parameters and publish its stream id
+    host.run(settings.blockSize);
+    events = GameEventStreams::find(host.getParameter(kEventStream));
+  }
+
+  // false if there is no way to learn instructions
+  bool isReady() const {
+    return events != nullptr;
+  }
+
+  // play until game over
+  void playGame(BotStats &stats) {
+    // start from scratch, going through start = 0 in case last game ended on its own
+    host.setParameter(kStart, 0);
+    host.setParameter(kStart, 1);
+    started = false;
+    gameRound = 0;
+    gameMiss = 0;
+    nextFrame = NO_ACTION;
+
+    while (true) {
+      queueActions(stats);
+      host.run(settings.blockSize);
+      stats.blocks++;
+      stats.frames += settings.blockSize;
+      stats.midiOut += host.getNbOutput();
+      drainEvents(stats);
+      if (started && !isRunning(status)) {
+        break;
+      }
+      if (nextFrame == NO_ACTION && status == PLAYING_WAIT) {
+        scheduleAnswer(stats);
+      }
+    }
+
+    // rounds completed
+    const uint64_t rounds = gameRound > 0 ? gameRound - 1 : 0;
+    stats.nbGames++;
+    stats.sumRounds += rounds;
+    if (rounds < stats.minRound) {
+      stats.minRound = rounds;
+    }
+    if (rounds > stats.maxRound) {
+      stats.maxRound = rounds;
+    }
+    stats.misses += gameMiss;
+  }
+
+ private:
+  static const uint64_t NO_ACTION = UINT64_MAX;
+
+  BotSettings settings;
+  SimonHost host;
+  GameEventStream *events = nullptr;
+  Rando ran;
+  uint64_t reactionFrames;
+  uint64_t durationFrames;
+  // max error when following rhythm, < 0 if not
+  double rhythmFrames;
+
+  // state of the game as seen through events
+  int status = WAITING;
+  int step = 0;
+  bool started = false;
+  uint64_t gameRound = 0;
+  uint64_t gameMiss = 0;
+  // last change of status
+  uint64_t statusFrame = 0;
+  // instructions of current round, and when they were played
+  std::vector<int> learned;
+  std::vector<uint64_t> learnedFrames;
+  // last note on sent
+  uint64_t lastOnFrame = 0;
+
+  // pending note: absolute frame of next note on / note off, NO_ACTION if none
+  uint64_t nextFrame = NO_ACTION;
+  bool nextIsOn = false;
+  int nextNote = 0;
+
+  // answer with next note of the sequence, or a wrong one
+  void scheduleAnswer(BotStats &stats) {
+    // lost track of instructions, give up this game
+    if (step < 0 || step >= (int) learned.size()) {
+      fprintf(stderr, "warning: no instruction known for step %d, stopping game\n", step);
+      host.setParameter(kStart, 0);
+      nextFrame = NO_ACTION;
+      return;
+    }
+    int note = learned[step];
+    if (settings.errorRate > 0 && ran.next() < settings.errorRate * 4294967296.0) {
+      // a neighbor is always another note in the layout, unless out of MIDI range
+      note = note < 127 ? note + 1 : note - 1;
+      stats.wrongNotes++;
+    }
+    nextNote = note;
+    nextIsOn = true;
+    nextFrame = statusFrame + reactionFrames;
+    // same interval as instructions from previous note
+    if (rhythmFrames >= 0 && step > 0) {
+      const double error = rhythmFrames * (2.0 * ran.next() / 4294967296.0 - 1);
+      nextFrame = lastOnFrame + (learnedFrames[step] - learnedFrames[step - 1]) + (int64_t) error;
+    }
+    if (nextFrame < host.getFrame()) {
+      nextFrame = host.getFrame();
+    }
+  }
+
+  // send what is due in next block, note off right after note on if both fit
+  void queueActions(BotStats &stats) {
+    const uint64_t blockStart = host.getFrame();
+    const uint64_t blockEnd = blockStart + settings.blockSize;
+    while (nextFrame != NO_ACTION && nextFrame < blockEnd) {
+      const uint32_t frame = nextFrame - blockStart;
+      if (nextIsOn) {
+        host.noteOn(nextNote, 100, 0, frame);
+        lastOnFrame = nextFrame;
+        stats.notesPlayed++;
+        nextIsOn = false;
+        nextFrame += durationFrames;
+      }
+      else {
+        host.noteOff(nextNote, 0, frame);
+        nextFrame = NO_ACTION;
+      }
+      stats.midiIn++;
+    }
+  }
+
+  void drainEvents(BotStats &stats) {
+    GameEvent event;
+    while (events->queue.pop(event)) {
+      stats.gameEvents++;
+      switch (event.type) {
+      case EV_STATUS:
+        status = event.value;
+        statusFrame = event.frame;
+        if (status == INSTRUCTIONS) {
+          learned.clear();
+          learnedFrames.clear();
+        }
+        if (isRunning(status)) {
+          started = true;
+        }
+        break;
+      case EV_ROUND:
+        // scores of the previous round
+        if (event.value > 1) {
+          stats.timedRounds++;
+          stats.sumTimingMean += host.getParameter(kTimingMean);
+          stats.sumTimingJitter += host.getParameter(kTimingJitter);
+        }
+        gameRound = event.value;
+        // enough for an endless game, stopped during instructions of next round
+        if (settings.endlessRounds > 0 && gameRound > settings.endlessRounds) {
+          host.setParameter(kStart, 0);
+        }
+        break;
+      case EV_STEP:
+        step = event.value;
+        break;
+      case EV_MISS:
+        if (event.value > 0) {
+          gameMiss++;
+        }
+        break;
+      case EV_NOTE:
+        if (status == INSTRUCTIONS && event.value >= 0) {
+          learned.push_back(event.value);
+          learnedFrames.push_back(event.frame);
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    if (events->dropped.exchange(0) > 0) {
+      fprintf(stderr, "warning: game events were dropped, bot might get lost\n");
+    }
+  }
+};
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-g games] [-e error rate] [-r reaction ms] [-d note duration ms] [-b block size] [-s sample rate] [-m rounds for miss] [-S seed] [-E rounds in endless mode] [-t host tempo] [-R rhythm error ms] [-T rhythm tolerance ms] [-o output.csv]\n", name);
+}
+
+int main(int argc, char **argv) {
+  BotSettings settings;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+      usage(argv[0]);
+      return 1;
+    }
+    const char *value = argv[++i];
+    switch (argv[i - 1][1]) {
+    case 'g':
+      settings.nbGames = atoll(value);
+      break;
+    case 'e':
+      settings.errorRate = atof(value);
+      break;
+    case 'r':
+      settings.reactionMs = atof(value);
+      break;
+    case 'd':
+      settings.durationMs = atof(value);
+      break;
+    case 'b':
+      settings.blockSize = atoi(value);
+      break;
+    case 's':
+      settings.sampleRate = atof(value);
+      break;
+    case 'm':
+      settings.roundsForMiss = atoi(value);
+      break;
+    case 'S':
+      settings.seed = atoi(value);
+      break;
+    case 'E':
+      settings.endlessRounds = atoll(value);
+      break;
+    case 't':
+      settings.tempo = atof(value);
+      break;
+    case 'R':
+      settings.rhythmMs = atof(value);
+      break;
+    case 'T':
+      settings.tolerance = atoi(value);
+      break;
+    case 'o':
+      settings.output = value;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (settings.blockSize < 1 || settings.blockSize > 8192 || settings.sampleRate <= 0 || settings.reactionMs < 0 || settings.tempo < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Bot bot(settings);
+  if (!bot.isReady()) {
+    fprintf(stderr, "no event stream available, cannot follow the game\n");
+    return 1;
+  }
+
+  BotStats stats;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint64_t g = 0; g < settings.nbGames; g++) {
+    bot.playGame(stats);
+  }
+  stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  const double meanRounds = stats.nbGames > 0 ? (double) stats.sumRounds / stats.nbGames : 0;
+  const double timingMean = stats.timedRounds > 0 ? stats.sumTimingMean / stats.timedRounds : 0;
+  const double timingJitter = stats.timedRounds > 0 ? stats.sumTimingJitter / stats.timedRounds : 0;
+  const double audioSeconds = stats.frames / settings.sampleRate;
+  printf("games: %llu in %.3f s, %.2f games/s, %.0fx real time\n", (unsigned long long) stats.nbGames, stats.seconds, stats.nbGames / stats.seconds, audioSeconds / stats.seconds);
+  printf("rounds completed: min %llu, mean %.2f, max %llu\n", (unsigned long long) stats.minRound, meanRounds, (unsigned long long) stats.maxRound);
+  printf("notes played: %llu (%llu wrong), misses: %llu\n", (unsigned long long) stats.notesPlayed, (unsigned long long) stats.wrongNotes, (unsigned long long) stats.misses);
+  if (stats.timedRounds > 0) {
+    printf("timing error per round: mean %.1f ms, jitter %.1f ms\n", timingMean, timingJitter);
+  }
+  printf("MIDI in: %llu, MIDI out: %llu, game events: %llu, blocks: %llu, ns/block: %.1f\n", (unsigned long long) stats.midiIn, (unsigned long long) stats.midiOut, (unsigned long long) stats.gameEvents, (unsigned long long) stats.blocks, stats.seconds * 1e9 / stats.blocks);
+
+  if (settings.output != nullptr) {
+    FILE *file = fopen(settings.output, "w");
+    if (file == nullptr) {
+      fprintf(stderr, "cannot open %s\n", settings.output);
+      return 1;
+    }
+    fprintf(file, "games,seconds,games_per_s,realtime_factor,min_round,mean_round,max_round,notes,wrong_notes,misses,midi_in,midi_out,game_events,blocks,ns_per_block,timing_mean_ms,timing_jitter_ms\n");
+    fprintf(file, "%llu,%.6f,%.3f,%.1f,%llu,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.1f,%.1f,%.1f\n",
+            (unsigned long long) stats.nbGames, stats.seconds, stats.nbGames / stats.seconds, audioSeconds / stats.seconds,
+            (unsigned long long) stats.minRound, meanRounds, (unsigned long long) stats.maxRound,
+            (unsigned long long) stats.notesPlayed, (unsigned long long) stats.wrongNotes, (unsigned long long) stats.misses,
+            (unsigned long long) stats.midiIn, (unsigned long long) stats.midiOut, (unsigned long long) stats.gameEvents,
+            (unsigned long long) stats.blocks, stats.seconds * 1e9 / stats.blocks, timingMean, timingJitter);
+    fclose(file);
+  }
+  return 0;
+}
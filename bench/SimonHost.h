@@ -0,0 +1,205 @@
+
+#ifndef SIMON_HOST_H
+#define SIMON_HOST_H
+
+#include "DistrhoPluginInternal.hpp"
+#include <vector>
+
+START_NAMESPACE_DISTRHO
+
+// how many MIDI events can be queued for, or received from, one block
+#define HOST_MAX_EVENTS 1024
+
+// Minimal headless host: one SimonPiano instance, MIDI in and out, audio in for pitch detection and out of the built-in synth, no UI.
+// Everything is preallocated, so that timings only account for the DSP.
+// Built with the audio variant of the plugin, see bench Makefile.
+static_assert(DISTRHO_PLUGIN_NUM_OUTPUTS > 0, "headless host expects the audio variant, SIMON_PIANO_AUDIO");
+class SimonHost {
+
+ public:
+  SimonHost(double sampleRate, uint32_t bufferSize)
+    : plugin(prepare(this, sampleRate, bufferSize), writeMidiCallback, nullptr, nullptr),
+      bufferSize(bufferSize) {
+    for (int channel = 0; channel < DISTRHO_PLUGIN_NUM_OUTPUTS; channel++) {
+      audio[channel].resize(bufferSize);
+      outputs[channel] = audio[channel].data();
+    }
+    // silence unless written, see getInput()
+    for (int channel = 0; channel < DISTRHO_PLUGIN_NUM_INPUTS; channel++) {
+      inAudio[channel].resize(bufferSize);
+      inputs[channel] = inAudio[channel].data();
+    }
+    plugin.activate();
+  }
+
+  ~SimonHost() {
+    plugin.deactivate();
+  }
+
+  // will be applied by the DSP at the beginning of next block
+  void setParameter(uint32_t index, float value) {
+    plugin.setParameterValue(index, value);
+  }
+
+  float getParameter(uint32_t index) const {
+    return plugin.getParameterValue(index);
+  }
+
+  // as a host saving and loading a project
+  String getState(const char *key) const {
+    return plugin.getStateValue(key);
+  }
+
+  void setState(const char *key, const char *value) {
+    plugin.setState(key, value);
+  }
+
+  void setSampleRate(double sampleRate) {
+    plugin.setSampleRate(sampleRate, true);
+  }
+
+  // transport rolling from frame 0 at this tempo, 4/4, position sent before each block. 0 to stop it.
+  void setTempo(double bpm) {
+    tempo = bpm;
+    if (tempo <= 0) {
+      setTimePosition(TimePosition());
+    }
+  }
+
+  // position for next blocks, when the transport is driven by the caller instead
+  void setTimePosition(const TimePosition &pos) {
+    plugin.setTimePosition(pos);
+  }
+
+  // queue events for next block, frame relative to its beginning. Should be sent in order. False if queue is full.
+  bool noteOn(uint8_t note, uint8_t velocity, uint8_t channel, uint32_t frame) {
+    return queue(0x90 | (channel & 0x0F), note, velocity, frame);
+  }
+
+  bool noteOff(uint8_t note, uint8_t channel, uint32_t frame) {
+    return queue(0x80 | (channel & 0x0F), note, 0, frame);
+  }
+
+  // any short message, e.g. control change
+  bool message(const uint8_t *data, uint8_t size, uint32_t frame) {
+    if (size < 1 || size > MidiEvent::kDataSize) {
+      return false;
+    }
+    return queue(data[0], size > 1 ? data[1] : 0, size > 2 ? data[2] : 0, frame, size);
+  }
+
+  // process one block with queued events, at most bufferSize frames
+  void run(uint32_t frames) {
+    if (tempo > 0) {
+      rollTransport();
+    }
+    nbOutput = 0;
+    plugin.run(inputs, outputs, frames, input, nbInput);
+    nbInput = 0;
+    curFrame += frames;
+  }
+
+  // MIDI sent by the plugin during last run()
+  uint32_t getNbOutput() const {
+    return nbOutput;
+  }
+
+  const MidiEvent &getOutput(uint32_t idx) const {
+    return output[idx];
+  }
+
+  // audio for next run(), to fill with bufferSize frames at most, kept as is across runs
+  float *getInput(int channel) {
+    return inAudio[channel].data();
+  }
+
+  // audio of last run(), frames as given
+  const float *getAudio(int channel) const {
+    return outputs[channel];
+  }
+
+  // events that did not fit in output since creation
+  uint32_t getNbDropped() const {
+    return nbDropped;
+  }
+
+  uint32_t getBufferSize() const {
+    return bufferSize;
+  }
+
+  // frames processed since creation
+  uint64_t getFrame() const {
+    return curFrame;
+  }
+
+ private:
+  PluginExporter plugin;
+  uint32_t bufferSize;
+  uint64_t curFrame = 0;
+  // tempo of the transport, 0 if stopped
+  double tempo = 0;
+  MidiEvent input[HOST_MAX_EVENTS];
+  uint32_t nbInput = 0;
+  MidiEvent output[HOST_MAX_EVENTS];
+  uint32_t nbOutput = 0;
+  uint32_t nbDropped = 0;
+  std::vector<float> audio[DISTRHO_PLUGIN_NUM_OUTPUTS];
+  float *outputs[DISTRHO_PLUGIN_NUM_OUTPUTS];
+  std::vector<float> inAudio[DISTRHO_PLUGIN_NUM_INPUTS];
+  const float *inputs[DISTRHO_PLUGIN_NUM_INPUTS];
+
+  // DPF reads those while creating the plugin
+  static void *prepare(SimonHost *host, double sampleRate, uint32_t bufferSize) {
+    d_nextSampleRate = sampleRate;
+    d_nextBufferSize = bufferSize;
+    return host;
+  }
+
+  // where the transport is at current frame
+  void rollTransport() {
+    TimePosition pos;
+    pos.playing = true;
+    pos.frame = curFrame;
+    pos.bbt.valid = true;
+    pos.bbt.beatsPerBar = 4;
+    pos.bbt.beatType = 4;
+    pos.bbt.ticksPerBeat = 1920;
+    pos.bbt.beatsPerMinute = tempo;
+    const double beats = curFrame * tempo / (60 * plugin.getSampleRate());
+    const uint64_t beat = beats;
+    pos.bbt.bar = beat / 4 + 1;
+    pos.bbt.beat = beat % 4 + 1;
+    pos.bbt.tick = (beats - beat) * pos.bbt.ticksPerBeat;
+    pos.bbt.barStartTick = (pos.bbt.bar - 1) * 4 * pos.bbt.ticksPerBeat;
+    plugin.setTimePosition(pos);
+  }
+
+  bool queue(uint8_t status, uint8_t data1, uint8_t data2, uint32_t frame, uint8_t size = 3) {
+    if (nbInput >= HOST_MAX_EVENTS) {
+      return false;
+    }
+    MidiEvent &event = input[nbInput++];
+    event.frame = frame;
+    event.size = size;
+    event.data[0] = status;
+    event.data[1] = data1 & 0x7F;
+    event.data[2] = data2 & 0x7F;
+    event.data[3] = 0;
+    event.dataExt = nullptr;
+    return true;
+  }
+
+  static bool writeMidiCallback(void *ptr, const MidiEvent &midiEvent) {
+    SimonHost *host = (SimonHost *) ptr;
+    if (host->nbOutput >= HOST_MAX_EVENTS) {
+      host->nbDropped++;
+      return false;
+    }
+    host->output[host->nbOutput++] = midiEvent;
+    return true;
+  }
+};
+
+END_NAMESPACE_DISTRHO
+
+#endif /* SIMON_HOST_H */
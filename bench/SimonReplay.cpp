@@ -0,0 +1,221 @@
+// Replay a capture through the DSP, deterministically and as fast as possible.
+// Captures are recorded by the plugin when SIMON_PIANO_CAPTURE points to a file, see SimonCapture.h.
+// usage: simon-replay capture.bin [-t trace.txt] [-n repeats]
+// The trace lists every MIDI event sent by the plugin, to compare runs or versions.
+
+#include "SimonHost.h"
+#include "SimonCapture.h"
+#include "SimonState.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+USE_NAMESPACE_DISTRHO
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s capture.bin [-t trace.txt] [-n repeats]\n", name);
+}
+
+// whole capture in memory, so that timings only account for the DSP
+static bool load(const char *path, CaptureHeader &header, std::vector<CaptureRecord> &records) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0) {
+    fprintf(stderr, "%s is not a capture\n", path);
+    fclose(file);
+    return false;
+  }
+  if (header.version < 1 || header.version > CAPTURE_VERSION) {
+    fprintf(stderr, "unsupported capture version %u\n", header.version);
+    fclose(file);
+    return false;
+  }
+  if (header.version < 3) {
+    fprintf(stderr, "warning: capture version %u does not record state loaded by the host, a restored session or a melody will diverge\n", header.version);
+  }
+  CaptureRecord record;
+  while (fread(&record, sizeof(record), 1, file) == 1) {
+    records.push_back(record);
+  }
+  fclose(file);
+  return true;
+}
+
+// one run of the capture, return number of blocks
+static uint64_t replay(const CaptureHeader &header, const std::vector<CaptureRecord> &records, FILE *trace) {
+  // same seed as the capture, never capture the replay itself
+  char seed[16];
+  snprintf(seed, sizeof(seed), "%u", header.seed);
+  setenv(CAPTURE_ENV_SEED, seed, 1);
+  unsetenv(CAPTURE_ENV_PATH);
+
+  SimonHost host(header.sampleRate, header.bufferSize);
+  uint64_t nbBlocks = 0;
+  // block being filled, UINT64_MAX if none yet
+  uint64_t blockFrame = UINT64_MAX;
+  uint32_t blockSize = 0;
+  // host transport, as last seen by the plugin
+  TimePosition pos;
+  pos.bbt.ticksPerBeat = 1920;
+  // state being read back, per CaptureStateKey
+  static const char *const stateKeys[CAP_STATE_COUNT] = { STATE_KEY, MELODY_KEY };
+  std::string states[CAP_STATE_COUNT];
+
+  // run pending block, trace its output
+  auto flush = [&]() {
+    if (blockFrame == UINT64_MAX) {
+      return;
+    }
+    if (host.getFrame() != blockFrame) {
+      fprintf(stderr, "warning: capture jumps from frame %llu to %llu\n", (unsigned long long) host.getFrame(), (unsigned long long) blockFrame);
+    }
+    host.run(blockSize);
+    nbBlocks++;
+    if (trace != nullptr) {
+      for (uint32_t i = 0; i < host.getNbOutput(); i++) {
+        const MidiEvent &event = host.getOutput(i);
+        fprintf(trace, "%llu", (unsigned long long) (blockFrame + event.frame));
+        for (uint32_t j = 0; j < event.size && j < MidiEvent::kDataSize; j++) {
+          fprintf(trace, " %02x", event.data[j]);
+        }
+        fprintf(trace, "\n");
+      }
+    }
+    blockFrame = UINT64_MAX;
+  };
+
+  for (const CaptureRecord &record : records) {
+    switch (record.type) {
+    case CAP_BLOCK:
+      flush();
+      // a state is recorded within a block, what is left was cut short by losses
+      for (std::string &state : states) {
+        state.clear();
+      }
+      blockFrame = record.frame;
+      blockSize = record.count;
+      break;
+    case CAP_SAMPLE_RATE:
+      flush();
+      host.setSampleRate(record.count);
+      break;
+    case CAP_PARAMETER:
+      // applied at the beginning of pending block
+      host.setParameter(record.index, record.value);
+      break;
+    case CAP_MIDI:
+      if (blockFrame != UINT64_MAX && record.frame >= blockFrame && record.size >= 1) {
+        const uint8_t status = record.midi[0] & 0xF0;
+        const uint8_t channel = record.midi[0] & 0x0F;
+        const uint32_t frame = record.frame - blockFrame;
+        // note on with velocity 0 is left as such, the plugin decides
+        if (status == 0x90 && record.size >= 3) {
+          host.noteOn(record.midi[1], record.midi[2], channel, frame);
+        }
+        else if (status == 0x80 && record.size >= 3) {
+          host.noteOff(record.midi[1], channel, frame);
+        }
+        // for pass-through
+        else {
+          host.message(record.midi, record.size, frame);
+        }
+      }
+      break;
+    // transport only captured with tempo sync, for the pending block
+    case CAP_TEMPO:
+      pos.playing = record.index != 0;
+      pos.bbt.valid = pos.playing;
+      pos.bbt.beatsPerMinute = record.value;
+      host.setTimePosition(pos);
+      break;
+    case CAP_BEAT:
+      pos.bbt.tick = record.value * pos.bbt.ticksPerBeat;
+      host.setTimePosition(pos);
+      break;
+    // picked up at the beginning of pending block, as far as replay goes
+    case CAP_STATE:
+      if (record.index < CAP_STATE_COUNT) {
+        std::string &state = states[record.index];
+        state.append(record.text, std::min<uint32_t>(record.size, sizeof(record.text)));
+        if (record.size < sizeof(record.text)) {
+          host.setState(stateKeys[record.index], state.c_str());
+          state.clear();
+        }
+      }
+      break;
+    case CAP_DROPPED:
+      fprintf(stderr, "warning: %u records were lost during capture around frame %llu, replay will diverge\n", record.count, (unsigned long long) record.frame);
+      break;
+    default:
+      break;
+    }
+  }
+  flush();
+  return nbBlocks;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+  const char *path = argv[1];
+  const char *tracePath = nullptr;
+  int repeats = 1;
+  for (int i = 2; i < argc; i++) {
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    if (strcmp(argv[i], "-t") == 0) {
+      tracePath = argv[++i];
+    }
+    else if (strcmp(argv[i], "-n") == 0) {
+      repeats = atoi(argv[++i]);
+    }
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (repeats < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  CaptureHeader header;
+  std::vector<CaptureRecord> records;
+  if (!load(path, header, records)) {
+    return 1;
+  }
+  printf("capture: %zu records, seed %u, %.0f Hz, buffer size %u\n", records.size(), header.seed, header.sampleRate, header.bufferSize);
+
+  FILE *trace = nullptr;
+  if (tracePath != nullptr) {
+    trace = fopen(tracePath, "w");
+    if (trace == nullptr) {
+      fprintf(stderr, "cannot open %s\n", tracePath);
+      return 1;
+    }
+  }
+
+  uint64_t nbBlocks = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeats; i++) {
+    // only trace first run, others are identical
+    nbBlocks += replay(header, records, i == 0 ? trace : nullptr);
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (trace != nullptr) {
+    fclose(trace);
+  }
+
+  printf("replayed %d times: %llu blocks in %.3f s, %.1f ns/block\n", repeats, (unsigned long long) nbBlocks, seconds, nbBlocks > 0 ? seconds * 1e9 / nbBlocks : 0);
+  return 0;
+}
@@ -0,0 +1,234 @@
+// Soak test of game timing: a day of games at 96 kHz, block size changing every block, each instruction checked against the exact frame expected.
+// Deadlines are predicted from timings in frames: each round counts from the frame it starts, each step from the previous one, so no drift is allowed.
+// Sample rate changes twice along the way: pending deadlines must keep their distance in seconds (to the nearest frame), next rounds follow the new rate.
+// usage: simon-soak [hours of audio]
+// Exit code is not 0 upon any mismatch.
+
+#include "SimonHost.h"
+#include "SimonUtils.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+USE_NAMESPACE_DISTRHO
+
+// blocks from 1 frame up to that
+#define SOAK_MAX_BLOCK 4096
+// sample rate of the first and last third, and of the one in-between
+#define SOAK_RATE 96000
+#define SOAK_OTHER_RATE 44100
+// in ms, whole numbers of frames at both rates. Interval is longer than a block, so that a round never starts within the block of its first instruction
+#define SOAK_INTERVAL 150
+#define SOAK_DURATION 100
+// mismatches printed, the rest are only counted
+#define SOAK_MAX_REPORTS 10
+
+// note on or off of an instruction, at an absolute frame
+struct Deadline {
+  uint64_t frame;
+  bool on;
+};
+
+class Soak {
+
+ public:
+  Soak() : host(SOAK_RATE, SOAK_MAX_BLOCK) {
+    host.setParameter(kInterval, SOAK_INTERVAL);
+    host.setParameter(kDuration, SOAK_DURATION);
+    host.setParameter(kCurve, CURVE_FLAT);
+    host.setParameter(kTolerance, 0);
+    host.setParameter(kDebounce, 0);
+    setTimings(SOAK_RATE);
+    ran.srand(1);
+    expected.reserve(2 * MAX_ROUND);
+    learned.reserve(MAX_ROUND);
+  }
+
+  // simulate that many seconds, the other sample rate in-between both given times
+  void run(double seconds, double switchTime, double backTime) {
+    while (elapsed < seconds) {
+      const uint64_t blockStart = host.getFrame();
+      if (elapsed >= switchTime && elapsed < backTime && rate == SOAK_RATE) {
+        changeRate(SOAK_OTHER_RATE);
+      }
+      else if (elapsed >= backTime && rate != SOAK_RATE) {
+        changeRate(SOAK_RATE);
+      }
+      const uint32_t blockSize = 1 + ran.bounded(SOAK_MAX_BLOCK);
+      // from the state published by last block
+      const int status = host.getParameter(kStatus);
+      bool answering = false;
+      if (!isRunning(status) && !starting) {
+        // going through start = 0 in case last game ended on its own, new game is applied at the beginning of the block
+        host.setParameter(kStart, 0);
+        host.setParameter(kStart, 1);
+        starting = true;
+        nbGames++;
+        startRound(blockStart + interval, 1);
+      }
+      else if (isRunning(status)) {
+        starting = false;
+      }
+      if (status == PLAYING_WAIT && !answered) {
+        answer(blockStart);
+        answering = true;
+      }
+      // a round starting in this block is compiled with current timings
+      if (!compiled && roundOrigin < blockStart + blockSize) {
+        compileRound();
+      }
+      host.run(blockSize);
+      elapsed += blockSize / rate;
+      nbBlocks++;
+      // our own notes are played through, and no instruction can be due in the same block
+      if (!answering) {
+        check(blockStart);
+      }
+    }
+  }
+
+  uint64_t getNbMismatches() const {
+    return nbMismatches;
+  }
+
+  void printStats(double seconds) const {
+    printf("soak: %.1f h of audio in %.1f s, %llu frames, %llu blocks, %llu games, %llu rounds\n", elapsed / 3600, seconds, (unsigned long long) host.getFrame(), (unsigned long long) nbBlocks, (unsigned long long) nbGames, (unsigned long long) nbRounds);
+    printf("instructions: %llu note on and off checked, %llu mismatches\n", (unsigned long long) nbChecked, (unsigned long long) nbMismatches);
+  }
+
+ private:
+  SimonHost host;
+  Rando ran;
+  double rate = SOAK_RATE;
+  // audio simulated so far, in seconds
+  double elapsed = 0;
+  // timings at current rate, in frames
+  uint64_t interval = 0;
+  uint64_t duration = 0;
+  // round to come or in progress: frame it starts, its number, whether its deadlines are known yet
+  uint64_t roundOrigin = 0;
+  int round = 0;
+  bool compiled = true;
+  // deadlines of current round, the ones heard so far and their notes
+  std::vector<Deadline> expected;
+  size_t heard = 0;
+  std::vector<uint8_t> learned;
+  bool answered = false;
+  bool starting = false;
+  // summary
+  uint64_t nbBlocks = 0;
+  uint64_t nbGames = 0;
+  uint64_t nbRounds = 0;
+  uint64_t nbChecked = 0;
+  uint64_t nbMismatches = 0;
+
+  void setTimings(double newRate) {
+    rate = newRate;
+    interval = SOAK_INTERVAL * (uint64_t) rate / 1000;
+    duration = SOAK_DURATION * (uint64_t) rate / 1000;
+  }
+
+  // the plugin keeps pending deadlines at the same distance in seconds from the current frame
+  void changeRate(double newRate) {
+    const uint64_t origin = host.getFrame();
+    const double ratio = newRate / rate;
+    host.setSampleRate(newRate);
+    setTimings(newRate);
+    for (size_t i = heard; i < expected.size(); i++) {
+      expected[i].frame = rescale(expected[i].frame, origin, ratio);
+    }
+    if (!compiled) {
+      roundOrigin = rescale(roundOrigin, origin, ratio);
+    }
+  }
+
+  static uint64_t rescale(uint64_t frame, uint64_t origin, double ratio) {
+    return frame > origin ? origin + (uint64_t) ((frame - origin) * ratio + 0.5) : frame;
+  }
+
+  void startRound(uint64_t origin, int newRound) {
+    roundOrigin = origin;
+    round = newRound;
+    compiled = false;
+  }
+
+  // each note waits for an interval and is held for a duration
+  void compileRound() {
+    expected.clear();
+    learned.clear();
+    heard = 0;
+    answered = false;
+    uint64_t deadline = roundOrigin;
+    for (int step = 0; step < round; step++) {
+      deadline += interval;
+      expected.push_back({deadline, true});
+      deadline += duration;
+      expected.push_back({deadline, false});
+    }
+    compiled = true;
+    nbRounds++;
+  }
+
+  void mismatch(const char *what, uint64_t frame, uint64_t expectedFrame) {
+    if (nbMismatches < SOAK_MAX_REPORTS) {
+      fprintf(stderr, "mismatch in round %d, deadline %llu: %s at frame %llu, expected at %llu\n", round, (unsigned long long) heard, what, (unsigned long long) frame, (unsigned long long) expectedFrame);
+    }
+    nbMismatches++;
+  }
+
+  // instructions sent during last block against the deadlines of the round
+  void check(uint64_t blockStart) {
+    for (uint32_t i = 0; i < host.getNbOutput(); i++) {
+      const MidiEvent &event = host.getOutput(i);
+      const uint8_t type = event.data[0] & 0xF0;
+      if (type != 0x90 && type != 0x80) {
+        continue;
+      }
+      const bool on = type == 0x90 && event.data[2] > 0;
+      const uint64_t frame = blockStart + event.frame;
+      if (heard >= expected.size()) {
+        mismatch(on ? "extra note on" : "extra note off", frame, 0);
+        continue;
+      }
+      const Deadline &deadline = expected[heard++];
+      nbChecked++;
+      if (on != deadline.on || frame != deadline.frame) {
+        mismatch(on ? "note on" : "note off", frame, deadline.frame);
+      }
+      if (on) {
+        learned.push_back(event.data[1]);
+      }
+    }
+  }
+
+  // whole round played back at the beginning of the block, last note off starts next round right away
+  void answer(uint64_t blockStart) {
+    if (heard < expected.size()) {
+      mismatch("player's turn", blockStart, expected[heard].frame);
+    }
+    for (uint8_t note : learned) {
+      host.noteOn(note, 100, 0, 0);
+      host.noteOff(note, 0, 0);
+    }
+    answered = true;
+    if (round < MAX_ROUND) {
+      startRound(blockStart, round + 1);
+    }
+  }
+};
+
+int main(int argc, char **argv) {
+  const double hours = argc > 1 ? atof(argv[1]) : 24;
+  if (hours <= 0 || argc > 2) {
+    fprintf(stderr, "usage: %s [hours of audio]\n", argv[0]);
+    return 1;
+  }
+  // a third at each rate
+  const double seconds = hours * 3600;
+  Soak soak;
+  const auto start = std::chrono::steady_clock::now();
+  soak.run(seconds, seconds / 3, seconds / 3 * 2);
+  soak.printStats(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  return soak.getNbMismatches() > 0 ? 1 : 0;
+}
@@ -2,22 +2,46 @@
 #ifndef DISTRHO_PLUGIN_INFO_H_INCLUDED
 #define DISTRHO_PLUGIN_INFO_H_INCLUDED
 
+// audio variant ("make AUDIO=true"), a plugin of its own with audio outputs for the built-in synth and an audio input for pitch detection, the default one is MIDI only
+// the web version is always the audio one, see HOTFIX below
+#if defined(DISTRHO_OS_WASM) && !defined(SIMON_PIANO_AUDIO)
+#define SIMON_PIANO_AUDIO 1
+#endif
+
+#if defined(SIMON_PIANO_AUDIO) && !defined(DISTRHO_OS_WASM)
+#define DISTRHO_PLUGIN_NAME  "SimonPiano-Audio"
+#define DISTRHO_PLUGIN_URI   "http://jfrey.info/simon-piano-audio"
+#define DISTRHO_PLUGIN_CLAP_ID "simon-piano-audio"
+#else
 #define DISTRHO_PLUGIN_NAME  "SimonPiano"
 #define DISTRHO_PLUGIN_URI   "http://jfrey.info/simon-piano"
 #define DISTRHO_PLUGIN_CLAP_ID "simon-piano"
+#endif
 
 
+// audio input for pitch detection, only the first one is listened to
 // HOTFIX: with DPF current implementation WASM expects an audio context with inputs and outputs
 #if defined(DISTRHO_OS_WASM)
 #define DISTRHO_PLUGIN_NUM_INPUTS   2
-#define DISTRHO_PLUGIN_NUM_OUTPUTS  2
+#elif defined(SIMON_PIANO_AUDIO)
+#define DISTRHO_PLUGIN_NUM_INPUTS   1
 #else
 #define DISTRHO_PLUGIN_NUM_INPUTS   0
+#endif
+// built-in synth, silent unless enabled -- same signal on both
+#if defined(SIMON_PIANO_AUDIO)
+#define DISTRHO_PLUGIN_NUM_OUTPUTS  2
+#else
 #define DISTRHO_PLUGIN_NUM_OUTPUTS  0
 #endif
 #define DISTRHO_PLUGIN_WANT_MIDI_INPUT 1
 #define DISTRHO_PLUGIN_WANT_MIDI_OUTPUT 1
 #define DISTRHO_PLUGIN_IS_RT_SAFE   1
+// host tempo and position, for tempo sync
+#define DISTRHO_PLUGIN_WANT_TIMEPOS 1
+// best score and game in progress saved with the project, state changes on our side
+#define DISTRHO_PLUGIN_WANT_STATE 1
+#define DISTRHO_PLUGIN_WANT_FULL_STATE 1
 
 #define DISTRHO_PLUGIN_HAS_UI 1
 #define DISTRHO_UI_DEFAULT_WIDTH 800
@@ -25,6 +49,10 @@
 #define DISTRHO_UI_USER_RESIZABLE 1
 #define DISTRHO_UI_URI DISTRHO_PLUGIN_URI "#UI"
 
+// multi-player: one game per MIDI channel, each with its own outputs
+#define MAX_LANES 16
+#define LANE_NB_OUTPUTS 3
+
 enum Parameters {
     kStart,
     kRoot, 
@@ -74,8 +102,67 @@ enum Parameters {
     kMaxMiss,
     // some misc info
     kMaxRound,
+    // id of the stream of events for the UI, when it lives in the same binary
+    kEventStream,
+
+    // inputs added later on, last to keep indices of existing sessions
+    kSeed,
+    kPregenerate,
+    kEndless,
+    kDebounce,
+    // number of incoming notes ignored by debounce
+    kFiltered,
+    kTempoSync,
+    // timings of instructions, and how they speed up along the game
+    kInterval,
+    kDuration,
+    kCurve,
+    kSpeedUp,
+    // speed of instructions for current round, in notes per minute
+    kTempo,
+    // rhythm: max timing error before a step counts as a miss, 0 to only score
+    kTolerance,
+    // timing error of the player over current round, vs instructions
+    kTimingMean,
+    kTimingJitter,
+    // which MIDI messages other than notes go through, bits of PassThrough
+    kPassThrough,
+    // number of players, one game per input channel if more than one
+    kLanes,
+    // sequence from a MIDI file instead of random notes, which line of the file, and its number of notes
+    kMelody,
+    kMelodyTrack,
+    kMelodyLength,
+    // how notes are drawn, see Generator, and what shapes melodic lines
+    kGenerator,
+    kMaxLeap,
+    kNoRepeat,
+    kStepwise,
+    kTonality,
+    // built-in synth playing the notes we send, on top of MIDI output
+    kSynth,
+    kSynthVolume,
+    // notes detected in audio input, as if played on the first channel
+    kAudioInput,
+    kAudioHop,
+    kAudioGate,
+    // set to 1 before and to 0 after changes to be applied at once, e.g. a preset from the UI, see ParameterQueue
+    kParameterGroup,
+
+    // outputs for each lane (status, round, miss), see laneParameter()
+    // NB: must stay last, new inputs go before so that only outputs are shifted
+    kLaneOutputs,
+
+    kParameterCount = kLaneOutputs + MAX_LANES * LANE_NB_OUTPUTS
+};
+
+enum States {
+    // best score and games in progress
+    kStateSession,
+    // path of the MIDI file of the melody to learn
+    kStateMelody,
 
-    kParameterCount
+    kStateCount
 };
 
 #endif
@@ -0,0 +1,90 @@
+
+#ifndef SIMON_ACTIVE_NOTES_H
+#define SIMON_ACTIVE_NOTES_H
+
+#include <stdint.h>
+
+// index of lowest bit set, value must not be 0
+inline unsigned int lowestBit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(value);
+#else
+  unsigned int idx = 0;
+  while (!(value & 1)) {
+    value >>= 1;
+    idx++;
+  }
+  return idx;
+#endif
+}
+
+// Every note we sent a note on for and not yet a note off, one 128-bit set per MIDI channel.
+class ActiveNotes {
+
+ public:
+  // mark note as sounding, return false if it was already
+  bool on(uint8_t note, uint8_t channel) {
+    note &= 0x7F;
+    channel &= 0x0F;
+    const uint64_t mask = (uint64_t) 1 << (note & 63);
+    const bool was = notes[channel][note >> 6] & mask;
+    notes[channel][note >> 6] |= mask;
+    channels |= 1 << channel;
+    return !was;
+  }
+
+  // mark note as released, return false if it was not sounding -- i.e. note off would be redundant
+  bool off(uint8_t note, uint8_t channel) {
+    note &= 0x7F;
+    channel &= 0x0F;
+    const uint64_t mask = (uint64_t) 1 << (note & 63);
+    if (!(notes[channel][note >> 6] & mask)) {
+      return false;
+    }
+    notes[channel][note >> 6] &= ~mask;
+    if (!notes[channel][0] && !notes[channel][1]) {
+      channels &= ~(1 << channel);
+    }
+    return true;
+  }
+
+  bool isOn(uint8_t note, uint8_t channel) const {
+    return notes[channel & 0x0F][(note & 0x7F) >> 6] & ((uint64_t) 1 << (note & 63));
+  }
+
+  // at least one note sounding
+  bool any() const {
+    return channels != 0;
+  }
+
+  // call release(note, channel) for every sounding note, only visiting set bits, then clear everything
+  template <typename F>
+  void flush(F release) {
+    while (channels) {
+      flushChannel(lowestBit(channels), release);
+    }
+  }
+
+  // same as flush(), for a single channel
+  template <typename F>
+  void flushChannel(uint8_t channel, F release) {
+    channel &= 0x0F;
+    for (unsigned int word = 0; word < 2; word++) {
+      uint64_t bits = notes[channel][word];
+      while (bits) {
+        release((uint8_t) (word * 64 + lowestBit(bits)), channel);
+        // clear lowest bit
+        bits &= bits - 1;
+      }
+      notes[channel][word] = 0;
+    }
+    channels &= ~(1 << channel);
+  }
+
+ private:
+  uint64_t notes[16][2] = {{0}};
+  // channels with at least one note sounding
+  uint32_t channels = 0;
+};
+
+#endif /* SIMON_ACTIVE_NOTES_H */
@@ -0,0 +1,270 @@
+
+#ifndef SIMON_CAPTURE_H
+#define SIMON_CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include "SimonEvents.h"
+#include "SimonFiles.h"
+
+// no thread nor file system to speak of on the web
+#if !defined(DISTRHO_OS_WASM)
+#include <thread>
+#include <chrono>
+#define SIMON_CAPTURE_ENABLED 1
+#endif
+
+// environment variables: path of the capture, enabling it, and seed to use instead of time, e.g. for replay
+// the file name gets the process and the instance, e.g. /tmp/capture.bin gives /tmp/capture-1234-1.bin
+#define CAPTURE_ENV_PATH "SIMON_PIANO_CAPTURE"
+#define CAPTURE_ENV_SEED "SIMON_PIANO_SEED"
+
+// file layout: CaptureHeader, then CaptureRecord until the end, both little endian as written by the machine
+#define CAPTURE_MAGIC "SIMONCAP"
+// version 2 adds host tempo, version 3 state loaded by the host, older files are still valid
+#define CAPTURE_VERSION 3
+
+struct CaptureHeader {
+  char magic[8];
+  uint32_t version;
+  // seed of the number generator
+  uint32_t seed;
+  // at plugin creation, sample rate might change later on
+  double sampleRate;
+  uint32_t bufferSize;
+  uint32_t reserved;
+};
+
+enum CaptureRecordType {
+  CAP_BLOCK, // frame: start of block, count: number of frames
+  CAP_SAMPLE_RATE, // frame: next block, count: new sample rate, rounded
+  CAP_PARAMETER, // frame: start of block it is applied on, index and value
+  CAP_MIDI, // frame: absolute frame of the event, size and midi data
+  CAP_DROPPED, // frame: last block, count: records lost since last one
+  CAP_TEMPO, // frame: start of block, only with tempo sync. index: transport rolling, value: beats per minute
+  CAP_BEAT, // frame: start of block, right after CAP_TEMPO. value: position within current beat, from 0 to 1
+  CAP_STATE, // frame: where it was picked up. index: CaptureStateKey, size and bytes of the value in text, a size below 4 ends it
+};
+
+// state as given by the host, see setState()
+enum CaptureStateKey {
+  CAP_STATE_SESSION, // blob in base64
+  CAP_STATE_MELODY, // path of the file
+  CAP_STATE_COUNT
+};
+
+// 16 bytes, in order of processing: each block then its parameter changes, its state then its MIDI events
+struct CaptureRecord {
+  uint64_t frame;
+  uint8_t type;
+  // number of bytes in midi or text
+  uint8_t size;
+  uint16_t index;
+  union {
+    uint8_t midi[4];
+    char text[4];
+    float value;
+    uint32_t count;
+  };
+};
+
+static_assert(sizeof(CaptureHeader) == 32 && sizeof(CaptureRecord) == 16, "capture layout must not depend on compiler");
+
+// records waiting to be written, about one second of heavy playing with small blocks
+#define CAPTURE_QUEUE_SIZE 16384
+
+// Capture of everything that goes into the DSP, for replay.
+// Audio thread only pushes records to a preallocated queue, a writer thread flushes them to disk.
+class CaptureWriter {
+
+ public:
+  // nullptr unless capture is asked through the environment and file can be created, see newInstanceId()
+  static CaptureWriter *fromEnvironment(double sampleRate, uint32_t bufferSize, uint32_t seed, uint32_t instanceId) {
+#if defined(SIMON_CAPTURE_ENABLED)
+    const char *path = getenv(CAPTURE_ENV_PATH);
+    if (path == nullptr || path[0] == '\0') {
+      return nullptr;
+    }
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "-%lu-%u", processId(), instanceId);
+    char created[1024];
+    FILE *file = createFile(path, suffix, created, sizeof(created));
+    if (file == nullptr) {
+      return nullptr;
+    }
+    CaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.seed = seed;
+    header.sampleRate = sampleRate;
+    header.bufferSize = bufferSize;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+      fclose(file);
+      return nullptr;
+    }
+    return new CaptureWriter(file, sampleRate);
+#else
+    (void) sampleRate;
+    (void) bufferSize;
+    (void) seed;
+    (void) instanceId;
+    return nullptr;
+#endif
+  }
+
+  // seed from the environment, if any
+  static bool seedFromEnvironment(uint32_t &seed) {
+#if defined(SIMON_CAPTURE_ENABLED)
+    const char *value = getenv(CAPTURE_ENV_SEED);
+    if (value != nullptr && value[0] != '\0') {
+      seed = strtoul(value, nullptr, 10);
+      return true;
+    }
+#else
+    (void) seed;
+#endif
+    return false;
+  }
+
+  // flush everything left and close file
+  ~CaptureWriter() {
+#if defined(SIMON_CAPTURE_ENABLED)
+    running.store(false);
+    if (writer.joinable()) {
+      writer.join();
+    }
+    // let replay know about last losses
+    const uint32_t nbDropped = dropped.exchange(0);
+    if (nbDropped > 0) {
+      CaptureRecord record = makeRecord(0, CAP_DROPPED);
+      record.count = nbDropped;
+      fwrite(&record, sizeof(record), 1, file);
+    }
+    fclose(file);
+#endif
+  }
+
+  // audio thread, beginning of each block
+  void block(uint64_t frame, uint32_t nbFrames, double sampleRate) {
+    const uint32_t nbDropped = dropped.exchange(0, std::memory_order_relaxed);
+    if (nbDropped > 0) {
+      CaptureRecord record = makeRecord(frame, CAP_DROPPED);
+      record.count = nbDropped;
+      push(record);
+    }
+    if (sampleRate != lastSampleRate) {
+      lastSampleRate = sampleRate;
+      CaptureRecord record = makeRecord(frame, CAP_SAMPLE_RATE);
+      record.count = sampleRate + 0.5;
+      push(record);
+    }
+    CaptureRecord record = makeRecord(frame, CAP_BLOCK);
+    record.count = nbFrames;
+    push(record);
+  }
+
+  // audio thread, parameter applied at the beginning of the block
+  void parameter(uint64_t frame, uint32_t index, float value) {
+    CaptureRecord record = makeRecord(frame, CAP_PARAMETER);
+    record.index = index;
+    record.value = value;
+    push(record);
+  }
+
+  // audio thread, host transport at the beginning of the block
+  // note: stored as float, a tempo that cannot be represented exactly might shift a deadline by a frame upon replay
+  void tempo(uint64_t frame, bool rolling, double bpm, double beatPosition) {
+    CaptureRecord record = makeRecord(frame, CAP_TEMPO);
+    record.index = rolling;
+    record.value = bpm;
+    push(record);
+    record = makeRecord(frame, CAP_BEAT);
+    record.value = beatPosition;
+    push(record);
+  }
+
+  // audio thread, incoming MIDI event -- only short messages, sysex are skipped
+  void midi(uint64_t frame, uint32_t size, const uint8_t *data) {
+    if (size > 4) {
+      return;
+    }
+    CaptureRecord record = makeRecord(frame, CAP_MIDI);
+    record.size = size;
+    memcpy(record.midi, data, size);
+    push(record);
+  }
+
+  // audio thread, state loaded by the host once picked up, spread over as many records as needed
+  void state(uint64_t frame, CaptureStateKey key, const char *value) {
+    const size_t length = strlen(value);
+    for (size_t i = 0; i <= length; i += sizeof(CaptureRecord::text)) {
+      CaptureRecord record = makeRecord(frame, CAP_STATE);
+      record.index = key;
+      record.size = std::min(length - i, sizeof(record.text));
+      memcpy(record.text, value + i, record.size);
+      push(record);
+    }
+  }
+
+ private:
+  CaptureWriter(FILE *file, double sampleRate) : file(file), lastSampleRate(sampleRate) {
+#if defined(SIMON_CAPTURE_ENABLED)
+    writer = std::thread([this]() { writeLoop(); });
+#endif
+  }
+
+  FILE *file;
+  RingBuffer<CaptureRecord, CAPTURE_QUEUE_SIZE> queue;
+  std::atomic<uint32_t> dropped{0};
+  std::atomic<bool> running{true};
+  double lastSampleRate;
+#if defined(SIMON_CAPTURE_ENABLED)
+  std::thread writer;
+#endif
+
+  static CaptureRecord makeRecord(uint64_t frame, uint8_t type) {
+    CaptureRecord record;
+    memset(&record, 0, sizeof(record));
+    record.frame = frame;
+    record.type = type;
+    return record;
+  }
+
+  void push(const CaptureRecord &record) {
+    if (!queue.push(record)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+#if defined(SIMON_CAPTURE_ENABLED)
+  // writer thread, drain queue by batches until asked to stop, then one last time
+  void writeLoop() {
+    CaptureRecord batch[256];
+    bool last = false;
+    while (!last) {
+      last = !running.load();
+      unsigned int nbRecords = 0;
+      while (queue.pop(batch[nbRecords])) {
+        if (++nbRecords >= sizeof(batch) / sizeof(batch[0])) {
+          fwrite(batch, sizeof(CaptureRecord), nbRecords, file);
+          nbRecords = 0;
+        }
+      }
+      if (nbRecords > 0) {
+        fwrite(batch, sizeof(CaptureRecord), nbRecords, file);
+      }
+      fflush(file);
+      if (!last) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      }
+    }
+  }
+#endif
+};
+
+#endif /* SIMON_CAPTURE_H */
@@ -0,0 +1,208 @@
+
+#ifndef SIMON_EVENTS_H
+#define SIMON_EVENTS_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Wait-free queue between exactly one producer thread and one consumer thread, no allocation.
+// SIZE must be a power of two, one slot is kept empty.
+template <typename T, unsigned int SIZE>
+class RingBuffer {
+  static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "ring buffer size must be a power of two");
+
+ public:
+  // producer side, return false if full
+  bool push(const T &item) {
+    const uint32_t w = writePos.load(std::memory_order_relaxed);
+    const uint32_t next = (w + 1) & (SIZE - 1);
+    if (next == readPos.load(std::memory_order_acquire)) {
+      return false;
+    }
+    items[w] = item;
+    writePos.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side, return false if empty
+  bool pop(T &item) {
+    const uint32_t r = readPos.load(std::memory_order_relaxed);
+    if (r == writePos.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[r];
+    readPos.store((r + 1) & (SIZE - 1), std::memory_order_release);
+    return true;
+  }
+
+  // consumer side, discard everything
+  void clear() {
+    readPos.store(writePos.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+ private:
+  T items[SIZE];
+  std::atomic<uint32_t> writePos{0};
+  std::atomic<uint32_t> readPos{0};
+};
+
+// Queue from any number of producer threads to one consumer thread, no lock and no allocation.
+// Each producer reserves a slot (compare-and-swap, retried only if another producer got it first), then publishes it.
+// Consumer side is wait-free: a slot reserved but not published yet is seen as the end of the queue, order of reservation is kept.
+// SIZE must be a power of two, every slot is used.
+template <typename T, unsigned int SIZE>
+class SharedRingBuffer {
+  static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "ring buffer size must be a power of two");
+
+ public:
+  SharedRingBuffer() {
+    for (uint32_t i = 0; i < SIZE; i++) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // producer side, return false if full
+  bool push(const T &item) {
+    uint32_t pos = writePos.load(std::memory_order_relaxed);
+    while (true) {
+      Cell &cell = cells[pos & (SIZE - 1)];
+      // equal: free for this position, behind: still holds the item of previous lap, ahead: taken by another producer
+      const int32_t diff = (int32_t) (cell.sequence.load(std::memory_order_acquire) - pos);
+      if (diff == 0) {
+        if (writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.item = item;
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0) {
+        return false;
+      }
+      else {
+        pos = writePos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // consumer side, return false if empty
+  bool pop(T &item) {
+    if (!peek(0, item)) {
+      return false;
+    }
+    cells[readPos & (SIZE - 1)].sequence.store(readPos + SIZE, std::memory_order_release);
+    readPos++;
+    return true;
+  }
+
+  // consumer side, item that many places after the next one to pop, return false if it is not published yet
+  bool peek(uint32_t offset, T &item) const {
+    if (offset >= SIZE) {
+      return false;
+    }
+    const uint32_t pos = readPos + offset;
+    const Cell &cell = cells[pos & (SIZE - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != pos + 1) {
+      return false;
+    }
+    item = cell.item;
+    return true;
+  }
+
+ private:
+  // sequence: position the cell is free for, or that position + 1 once its item is published
+  struct Cell {
+    std::atomic<uint32_t> sequence;
+    T item;
+  };
+  Cell cells[SIZE];
+  std::atomic<uint32_t> writePos{0};
+  // only touched by the consumer
+  uint32_t readPos = 0;
+};
+
+// what changed in the game
+enum GameEventType {
+  EV_STATUS, // value: new status
+  EV_ROUND, // value: round number
+  EV_STEP, // value: step number
+  EV_MISS, // value: number of miss
+  EV_NOTE, // value: current note, -1 once released
+};
+
+// timestamped change, frame is absolute since plugin creation
+struct GameEvent {
+  uint64_t frame;
+  uint8_t type;
+  int32_t value;
+};
+
+// capacity of each stream, UI drains them every frame
+#define GAME_EVENTS_SIZE 256
+// streams available in the binary, beyond the UI falls back to parameters
+#define GAME_EVENTS_STREAMS 64
+
+// Events from one plugin instance to its UI.
+// Streams are never freed: UI can safely check a stream it got from an outdated id.
+struct GameEventStream {
+  RingBuffer<GameEvent, GAME_EVENTS_SIZE> queue;
+  // events that could not be pushed, UI should resync with parameters
+  std::atomic<uint32_t> dropped{0};
+  // id of the instance currently using this stream, 0 if free
+  std::atomic<uint32_t> owner{0};
+};
+
+// Static pool of streams shared by DSP and UI living in the same binary. When they do not (e.g. separate processes or lv2_sep), the UI will not find the id published by the DSP.
+class GameEventStreams {
+
+ public:
+  // DSP side: get a free stream, id is published through parameters; nullptr if none left
+  static GameEventStream *acquire(uint32_t &id) {
+    for (uint32_t i = 0; i < GAME_EVENTS_STREAMS; i++) {
+      uint32_t expected = 0;
+      // generation so that a reused stream has a new id, kept small to be exact as a float parameter
+      const uint32_t gen = (generation().fetch_add(1, std::memory_order_relaxed) % 0xFFFF) + 1;
+      const uint32_t newId = gen * GAME_EVENTS_STREAMS + i;
+      if (streams()[i].owner.compare_exchange_strong(expected, newId)) {
+        streams()[i].queue.clear();
+        streams()[i].dropped.store(0);
+        id = newId;
+        return &streams()[i];
+      }
+    }
+    id = 0;
+    return nullptr;
+  }
+
+  // DSP side: stream not used anymore
+  static void release(uint32_t id) {
+    if (id > 0) {
+      uint32_t expected = id;
+      streams()[id % GAME_EVENTS_STREAMS].owner.compare_exchange_strong(expected, 0);
+    }
+  }
+
+  // UI side: stream for this id, nullptr if it does not belong to this binary anymore (or never did)
+  static GameEventStream *find(uint32_t id) {
+    if (id == 0) {
+      return nullptr;
+    }
+    GameEventStream *stream = &streams()[id % GAME_EVENTS_STREAMS];
+    if (stream->owner.load() != id) {
+      return nullptr;
+    }
+    return stream;
+  }
+
+ private:
+  // function-local statics: one pool per binary even if included from several files
+  static GameEventStream *streams() {
+    static GameEventStream pool[GAME_EVENTS_STREAMS];
+    return pool;
+  }
+  static std::atomic<uint32_t> &generation() {
+    static std::atomic<uint32_t> gen{0};
+    return gen;
+  }
+};
+
+#endif /* SIMON_EVENTS_H */
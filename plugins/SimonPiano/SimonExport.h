@@ -0,0 +1,331 @@
+
+#ifndef SIMON_EXPORT_H
+#define SIMON_EXPORT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include "SimonEvents.h"
+#include "SimonActiveNotes.h"
+#include "SimonFiles.h"
+
+// same as capture, no thread nor file system on the web
+#if !defined(DISTRHO_OS_WASM)
+#include <thread>
+#include <chrono>
+#define SIMON_EXPORT_ENABLED 1
+#endif
+
+// environment variable: prefix of the files, one Standard MIDI File per game, named after the process, the instance and the game
+// e.g. /tmp/simon gives /tmp/simon-1234-1-1.mid, /tmp/simon-1234-1-2.mid... existing files are never overwritten
+#define EXPORT_ENV_PATH "SIMON_PIANO_EXPORT"
+
+// format 1, one track per source, notes on the channel they were sent or received
+enum ExportTrack {
+  EXPORT_INSTRUCTIONS,
+  EXPORT_PLAYER,
+  EXPORT_NB_TRACKS
+};
+
+// fixed tempo of 120 BPM, i.e. 1920 ticks per second, about half a millisecond
+#define EXPORT_DIVISION 960
+#define EXPORT_TEMPO 500000
+#define EXPORT_TICKS_PER_SECOND (EXPORT_DIVISION * 1000000.0 / EXPORT_TEMPO)
+
+enum ExportRecordType {
+  EXP_START, // new game, opens a file
+  EXP_NOTE, // note on or off for a track
+  EXP_END, // end of game, file is complete
+};
+
+// what the audio thread sends to the writer
+struct ExportRecord {
+  // time since the plugin started, in seconds, from frame positions
+  double time;
+  uint8_t type;
+  uint8_t track;
+  // full MIDI message, status with channel
+  uint8_t status;
+  uint8_t note;
+  uint8_t velocity;
+};
+
+// a game is quite sparse, this covers a few seconds of writer being late with very fast play
+#define EXPORT_QUEUE_SIZE 4096
+
+// Export of each game to a Standard MIDI File: instructions and notes from the player, as they happened.
+// Audio thread only pushes records to a preallocated queue, a writer thread streams them to disk.
+// The instruction track is written directly to the file, the player track to a temporary file appended once the game is over.
+class MidiExportWriter {
+
+ public:
+  // nullptr unless export is asked through the environment, see newInstanceId()
+  static MidiExportWriter *fromEnvironment(uint32_t instanceId) {
+#if defined(SIMON_EXPORT_ENABLED)
+    const char *prefix = getenv(EXPORT_ENV_PATH);
+    if (prefix == nullptr || prefix[0] == '\0') {
+      return nullptr;
+    }
+    return new MidiExportWriter(prefix, instanceId);
+#else
+    (void) instanceId;
+    return nullptr;
+#endif
+  }
+
+  // complete file of game in progress, if any
+  ~MidiExportWriter() {
+#if defined(SIMON_EXPORT_ENABLED)
+    running.store(false);
+    if (writer.joinable()) {
+      writer.join();
+    }
+#endif
+  }
+
+  // audio thread
+  void gameStart(double time) {
+    push({time, EXP_START, 0, 0, 0, 0});
+  }
+
+  // audio thread, status with channel, note on with velocity 0 is kept as such
+  void note(double time, uint8_t track, uint8_t status, uint8_t note, uint8_t velocity) {
+    push({time, EXP_NOTE, track, status, (uint8_t) (note & 0x7F), (uint8_t) (velocity & 0x7F)});
+  }
+
+  // audio thread
+  void gameEnd(double time) {
+    push({time, EXP_END, 0, 0, 0, 0});
+  }
+
+ private:
+  MidiExportWriter(const char *prefix, uint32_t instanceId) : instanceId(instanceId) {
+    snprintf(this->prefix, sizeof(this->prefix), "%s", prefix);
+#if defined(SIMON_EXPORT_ENABLED)
+    writer = std::thread([this]() { writeLoop(); });
+#endif
+  }
+
+  RingBuffer<ExportRecord, EXPORT_QUEUE_SIZE> queue;
+  std::atomic<uint32_t> dropped{0};
+  std::atomic<bool> running{true};
+  char prefix[1024];
+  uint32_t instanceId;
+#if defined(SIMON_EXPORT_ENABLED)
+  std::thread writer;
+#endif
+
+  void push(const ExportRecord &record) {
+    if (!queue.push(record)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+#if defined(SIMON_EXPORT_ENABLED)
+  // --- writer thread from here ---
+
+  // one track being streamed
+  struct Track {
+    FILE *file = nullptr;
+    // bytes of events so far, for the chunk header
+    uint32_t length = 0;
+    uint64_t lastTick = 0;
+    // to release what is still sounding at the end
+    ActiveNotes notes;
+  };
+
+  // game being written, file is nullptr if none
+  FILE *file = nullptr;
+  uint32_t nbGames = 0;
+  double startTime = 0;
+  double lastTime = 0;
+  // position of the length of first track in the file
+  long lengthPos = 0;
+  Track tracks[EXPORT_NB_TRACKS];
+
+  // drain queue by batches until asked to stop, then one last time
+  void writeLoop() {
+    bool last = false;
+    while (!last) {
+      last = !running.load();
+      ExportRecord record;
+      while (queue.pop(record)) {
+        switch (record.type) {
+        case EXP_START:
+          finish(record.time);
+          open(record.time);
+          break;
+        case EXP_NOTE:
+          if (file != nullptr && record.track < EXPORT_NB_TRACKS) {
+            writeNote(tracks[record.track], record);
+            lastTime = record.time;
+          }
+          break;
+        case EXP_END:
+          finish(record.time);
+          break;
+        default:
+          break;
+        }
+      }
+      if (file != nullptr) {
+        fflush(file);
+      }
+      if (!last) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      }
+    }
+    // interrupted game, ends with its last event
+    finish(lastTime);
+  }
+
+  static void write16(FILE *out, uint16_t value) {
+    const uint8_t bytes[2] = {(uint8_t) (value >> 8), (uint8_t) value};
+    fwrite(bytes, 1, 2, out);
+  }
+
+  static void write32(FILE *out, uint32_t value) {
+    const uint8_t bytes[4] = {(uint8_t) (value >> 24), (uint8_t) (value >> 16), (uint8_t) (value >> 8), (uint8_t) value};
+    fwrite(bytes, 1, 4, out);
+  }
+
+  // bytes to a track, counted for its length
+  static void writeBytes(Track &track, const uint8_t *bytes, uint32_t size) {
+    if (size == 0) {
+      return;
+    }
+    fwrite(bytes, 1, size, track.file);
+    track.length += size;
+  }
+
+  // variable-length quantity, 7 bits per byte most significant first, at most 4 bytes -- more than a day between two events
+  static void writeDelta(Track &track, uint64_t tick) {
+    uint32_t delta = tick > track.lastTick ? (tick - track.lastTick > 0x0FFFFFFF ? 0x0FFFFFFF : tick - track.lastTick) : 0;
+    track.lastTick += delta;
+    uint8_t bytes[4];
+    int nbBytes = 0;
+    do {
+      bytes[3 - nbBytes] = (delta & 0x7F) | (nbBytes > 0 ? 0x80 : 0);
+      delta >>= 7;
+      nbBytes++;
+    } while (delta > 0);
+    writeBytes(track, bytes + 4 - nbBytes, nbBytes);
+  }
+
+  static void writeMeta(Track &track, uint64_t tick, uint8_t type, const uint8_t *data, uint8_t size) {
+    writeDelta(track, tick);
+    const uint8_t header[3] = {0xFF, type, size};
+    writeBytes(track, header, 3);
+    writeBytes(track, data, size);
+  }
+
+  static void writeText(Track &track, uint64_t tick, uint8_t type, const char *text) {
+    writeMeta(track, tick, type, (const uint8_t *) text, strlen(text));
+  }
+
+  // ticks since the beginning of the game, never going back in time
+  uint64_t tickAt(double time) const {
+    return time > startTime ? llround((time - startTime) * EXPORT_TICKS_PER_SECOND) : 0;
+  }
+
+  void writeNote(Track &track, const ExportRecord &record) {
+    const uint8_t channel = record.status & 0x0F;
+    const bool on = (record.status & 0xF0) == 0x90 && record.velocity > 0;
+    if (on) {
+      track.notes.on(record.note, channel);
+    }
+    else {
+      track.notes.off(record.note, channel);
+    }
+    writeDelta(track, tickAt(record.time));
+    const uint8_t bytes[3] = {record.status, record.note, record.velocity};
+    writeBytes(track, bytes, 3);
+  }
+
+  // header, then first track is streamed and second one goes to a temporary file
+  void open(double time) {
+    char path[sizeof(prefix) + 8];
+    snprintf(path, sizeof(path), "%s.mid", prefix);
+    char suffix[48];
+    snprintf(suffix, sizeof(suffix), "-%lu-%u-%u", processId(), instanceId, ++nbGames);
+    char created[sizeof(path) + 64];
+    file = createFile(path, suffix, created, sizeof(created));
+    if (file == nullptr) {
+      return;
+    }
+    FILE *playerFile = tmpfile();
+    if (playerFile == nullptr) {
+      fclose(file);
+      file = nullptr;
+      return;
+    }
+    startTime = time;
+    lastTime = time;
+    fwrite("MThd", 1, 4, file);
+    write32(file, 6);
+    write16(file, 1);
+    write16(file, EXPORT_NB_TRACKS);
+    write16(file, EXPORT_DIVISION);
+    fwrite("MTrk", 1, 4, file);
+    // placeholder for the length, known at the end
+    lengthPos = ftell(file);
+    write32(file, 0);
+    for (int i = 0; i < EXPORT_NB_TRACKS; i++) {
+      tracks[i] = Track();
+    }
+    tracks[EXPORT_INSTRUCTIONS].file = file;
+    tracks[EXPORT_PLAYER].file = playerFile;
+    // tempo map in first track
+    const uint8_t tempo[3] = {(uint8_t) (EXPORT_TEMPO >> 16), (uint8_t) (EXPORT_TEMPO >> 8), (uint8_t) EXPORT_TEMPO};
+    writeMeta(tracks[EXPORT_INSTRUCTIONS], 0, 0x51, tempo, 3);
+    writeText(tracks[EXPORT_INSTRUCTIONS], 0, 0x03, "Instructions");
+    writeText(tracks[EXPORT_PLAYER], 0, 0x03, "Player");
+  }
+
+  // release what is sounding, end tracks, then patch length of the first one and append the second
+  void finish(double time) {
+    if (file == nullptr) {
+      return;
+    }
+    const uint64_t endTick = tickAt(time);
+    const uint32_t nbDropped = dropped.exchange(0);
+    if (nbDropped > 0) {
+      char text[64];
+      snprintf(text, sizeof(text), "%u events lost", nbDropped);
+      writeText(tracks[EXPORT_INSTRUCTIONS], endTick, 0x01, text);
+    }
+    for (int i = 0; i < EXPORT_NB_TRACKS; i++) {
+      Track &track = tracks[i];
+      track.notes.flush([&track, endTick](uint8_t note, uint8_t channel) {
+        writeDelta(track, endTick);
+        const uint8_t bytes[3] = {(uint8_t) (0x80 | channel), note, 0};
+        writeBytes(track, bytes, 3);
+      });
+      writeMeta(track, endTick, 0x2F, nullptr, 0);
+    }
+    fseek(file, lengthPos, SEEK_SET);
+    write32(file, tracks[EXPORT_INSTRUCTIONS].length);
+    fseek(file, 0, SEEK_END);
+    // copy by chunks, whatever the length of the game
+    FILE *playerFile = tracks[EXPORT_PLAYER].file;
+    fwrite("MTrk", 1, 4, file);
+    write32(file, tracks[EXPORT_PLAYER].length);
+    rewind(playerFile);
+    uint8_t buffer[4096];
+    size_t nbRead;
+    while ((nbRead = fread(buffer, 1, sizeof(buffer), playerFile)) > 0) {
+      fwrite(buffer, 1, nbRead, file);
+    }
+    fclose(playerFile);
+    fclose(file);
+    file = nullptr;
+    tracks[EXPORT_INSTRUCTIONS].file = nullptr;
+    tracks[EXPORT_PLAYER].file = nullptr;
+  }
+#endif
+};
+
+#endif /* SIMON_EXPORT_H */
@@ -0,0 +1,75 @@
+
+#ifndef SIMON_FILES_H
+#define SIMON_FILES_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <atomic>
+#if defined(_WIN32)
+#include <io.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+// attempts with another number before giving up, e.g. folder not writable
+#define FILES_MAX_ATTEMPTS 100
+
+// to tell apart files from several hosts or sessions
+inline unsigned long processId() {
+#if defined(_WIN32)
+  return _getpid();
+#else
+  return getpid();
+#endif
+}
+
+// a new number each time, for each plugin instance of the process
+inline uint32_t newInstanceId() {
+  static std::atomic<uint32_t> nbInstances{0};
+  return ++nbInstances;
+}
+
+// New file for writing, never an existing one: suffix is inserted before the extension of path, e.g. /tmp/capture.bin and -12-1 give /tmp/capture-12-1.bin,
+// then -2, -3... are appended to the suffix if that one is taken. created receives the name used. nullptr if no file could be created.
+inline FILE *createFile(const char *path, const char *suffix, char *created, size_t size) {
+  const char *slash = strrchr(path, '/');
+#if defined(_WIN32)
+  const char *backslash = strrchr(path, '\\');
+  if (backslash != nullptr && (slash == nullptr || backslash > slash)) {
+    slash = backslash;
+  }
+#endif
+  const char *dot = strrchr(path, '.');
+  const size_t stem = dot != nullptr && (slash == nullptr || dot > slash) ? dot - path : strlen(path);
+  for (int attempt = 1; attempt <= FILES_MAX_ATTEMPTS; attempt++) {
+    char number[16] = "";
+    if (attempt > 1) {
+      snprintf(number, sizeof(number), "-%d", attempt);
+    }
+    if (snprintf(created, size, "%.*s%s%s%s", (int) stem, path, suffix, number, path + stem) >= (int) size) {
+      return nullptr;
+    }
+    const int fd = open(created, O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0644);
+    if (fd >= 0) {
+      FILE *file = fdopen(fd, "wb");
+      if (file == nullptr) {
+        close(fd);
+      }
+      return file;
+    }
+    if (errno != EEXIST) {
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
+
+#endif /* SIMON_FILES_H */
@@ -0,0 +1,113 @@
+
+#ifndef SIMON_GENERATOR_H
+#define SIMON_GENERATOR_H
+
+#include <stdint.h>
+#include <math.h>
+#include "SimonUtils.h"
+
+// at most one outcome per MIDI note
+#define ALIAS_MAX_SIZE 128
+
+// what shapes the melodic generator, as set by parameters
+struct GeneratorSettings {
+  int type = GEN_UNIFORM;
+  // in semitones
+  int maxLeap = 12;
+  bool noRepeat = true;
+  // in %
+  int stepwise = 50;
+  int tonality = 50;
+
+  bool operator==(const GeneratorSettings &other) const {
+    return type == other.type && maxLeap == other.maxLeap && noRepeat == other.noRepeat && stepwise == other.stepwise && tonality == other.tonality;
+  }
+  bool operator!=(const GeneratorSettings &other) const {
+    return !(*this == other);
+  }
+};
+
+// Weighted draw among n outcomes in constant time, whatever the weights: Walker's alias method, built with Vose's algorithm.
+// Each slot keeps its own outcome with some probability, otherwise gives its alias -- one index and one comparison per draw.
+class AliasTable {
+
+ public:
+  // weights >= 0, uniform if they are all 0. O(n), no allocation.
+  void build(const float *weights, int n) {
+    if (n > ALIAS_MAX_SIZE) {
+      n = ALIAS_MAX_SIZE;
+    }
+    double total = 0;
+    for (int i = 0; i < n; i++) {
+      total += weights[i];
+    }
+    // scaled so that average is 1, slots below lend their remaining space to slots above
+    double scaled[ALIAS_MAX_SIZE];
+    uint8_t small[ALIAS_MAX_SIZE];
+    uint8_t large[ALIAS_MAX_SIZE];
+    int nbSmall = 0;
+    int nbLarge = 0;
+    for (int i = 0; i < n; i++) {
+      scaled[i] = total > 0 ? weights[i] * n / total : 1;
+      if (scaled[i] < 1) {
+        small[nbSmall++] = i;
+      }
+      else {
+        large[nbLarge++] = i;
+      }
+    }
+    while (nbSmall > 0 && nbLarge > 0) {
+      const uint8_t s = small[--nbSmall];
+      const uint8_t l = large[--nbLarge];
+      threshold[s] = toThreshold(scaled[s]);
+      alias[s] = l;
+      scaled[l] += scaled[s] - 1;
+      if (scaled[l] < 1) {
+        small[nbSmall++] = l;
+      }
+      else {
+        large[nbLarge++] = l;
+      }
+    }
+    // what is left is full, up to rounding errors
+    while (nbLarge > 0) {
+      const uint8_t l = large[--nbLarge];
+      threshold[l] = UINT32_MAX;
+      alias[l] = l;
+    }
+    while (nbSmall > 0) {
+      const uint8_t s = small[--nbSmall];
+      threshold[s] = UINT32_MAX;
+      alias[s] = s;
+    }
+  }
+
+  // index of an outcome, n as upon build
+  int draw(int n, Rando &ran) const {
+    const uint32_t i = ran.bounded(n);
+    return ran.next() < threshold[i] ? i : alias[i];
+  }
+
+ private:
+  // probability of keeping the slot, on 32 bits. A slot always kept is its own alias.
+  uint32_t threshold[ALIAS_MAX_SIZE];
+  uint8_t alias[ALIAS_MAX_SIZE];
+
+  static uint32_t toThreshold(double probability) {
+    const double value = probability * 4294967296.0;
+    return value >= UINT32_MAX ? UINT32_MAX : value <= 0 ? 0 : (uint32_t) value;
+  }
+};
+
+// how much an interval is favored, before leap and repeat are excluded
+inline float intervalWeight(const GeneratorSettings &settings, int semitones) {
+  return expf(-0.5f * settings.stepwise / 100 * semitones);
+}
+
+// how much a pitch class relative to root is favored: root, then fifth, then thirds
+inline float degreeWeight(const GeneratorSettings &settings, int pitchClass) {
+  static const float strength[12] = {1, 0, 0, 0.5f, 0.5f, 0, 0, 0.75f, 0, 0, 0, 0};
+  return 1 + 3.0f * settings.tonality / 100 * strength[pitchClass % 12];
+}
+
+#endif /* SIMON_GENERATOR_H */
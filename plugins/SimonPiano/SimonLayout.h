@@ -0,0 +1,235 @@
+
+#ifndef SIMON_LAYOUT_H
+#define SIMON_LAYOUT_H
+
+#include <stdint.h>
+#include "SimonUtils.h"
+#include "SimonGenerator.h"
+
+// Notes in use for a game, depending on root, number of notes and scale.
+// Cached since it only changes in-between games, backs drawing new notes and shifting player's notes.
+class NoteLayout {
+
+ public:
+  // sync with current settings, rebuild tables only upon change
+  // return true if layout changed
+  bool update(int newRoot, int newNbNotes, const int newScale[12]) {
+    bool changed = !valid || newRoot != root || newNbNotes != nbNotes;
+    for (int i = 0; i < 12 && !changed; i++) {
+      changed = (newScale[i] != 0) != scale[i];
+    }
+    if (changed) {
+      root = newRoot;
+      nbNotes = newNbNotes;
+      for (int i = 0; i < 12; i++) {
+        scale[i] = newScale[i] != 0;
+      }
+      rebuild();
+      valid = true;
+    }
+    return changed;
+  }
+
+  // how notes are drawn, transition tables are only rebuilt upon change
+  void setGenerator(const GeneratorSettings &newGenerator) {
+    if (newGenerator != generator) {
+      generator = newGenerator;
+      rebuildTransitions();
+    }
+  }
+
+  // if each note depends on the previous one
+  bool isChained() const {
+    return generator.type == GEN_MELODIC;
+  }
+
+  // notes outside scale are rejected on note on, rebuild only upon change
+  void setShallNotPass(bool newShallNotPass) {
+    if (newShallNotPass != shallNotPass) {
+      shallNotPass = newShallNotPass;
+      rebuildNoteOn();
+    }
+  }
+
+  // shifted note for an incoming note on, -1 if it should be ignored
+  int remapNoteOn(uint8_t note) const {
+    return noteOnMap[note & 0x7F];
+  }
+
+  // shifted note for an incoming note off, -1 if out of MIDI range once shifted
+  // note: not filtered by scale, we could well have a note off event after shall not pass was switched on
+  int remapNoteOff(uint8_t note) const {
+    return noteOffMap[note & 0x7F];
+  }
+
+  // pick a random note among candidates, fallback to root if there is none
+  int draw(Rando &ran) const {
+    if (nbCandidates > 0) {
+      return candidates[ran.bounded(nbCandidates)];
+    }
+    return root;
+  }
+
+  // always the same note for the same key and index, without storing anything
+  int drawAt(uint64_t key, uint64_t index) const {
+    Rando ran;
+    ran.srand(key ^ (index * 0x9E3779B97F4A7C15ULL));
+    return draw(ran);
+  }
+
+  // next note of a sequence with the current generator, previous < 0 for the first one
+  // melodic: transition from the previous note, or from the start table if it is not a candidate. O(1) either way.
+  int drawNext(int previous, Rando &ran) const {
+    if (!isChained() || nbCandidates == 0) {
+      return draw(ran);
+    }
+    const int from = previous >= 0 && previous < 128 ? candidateIndex[previous] : -1;
+    const AliasTable &table = from >= 0 ? transitions[from] : start;
+    return candidates[table.draw(nbCandidates, ran)];
+  }
+
+  // same as drawAt(), following the previous note
+  int drawNextAt(uint64_t key, uint64_t index, int previous) const {
+    Rando ran;
+    ran.srand(key ^ (index * 0x9E3779B97F4A7C15ULL));
+    return drawNext(previous, ran);
+  }
+
+  // shift input, considering the current root note and the interval (number of notes) on interest
+  int shift(int note) const {
+    // we seek position in interval
+    note = (note - root) % interval;
+    // % is remainder in C, not modulo, adapt
+    if (note < 0) {
+      note += interval;
+    }
+    // shift back compared to root
+    return note + root;
+  }
+
+  // if this note is part of the scale
+  bool isInScale(int note) const {
+    return scale[note % 12];
+  }
+
+  // true if at least one note of the scale is enabled, whatever the range
+  bool hasScale() const {
+    for (int i = 0; i < 12; i++) {
+      if (scale[i]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  unsigned int getNbCandidates() const {
+    return nbCandidates;
+  }
+
+ private:
+  // list candidates and interval, remap input notes
+  void rebuild() {
+    // round number of notes to next octave
+    interval = (nbNotes + 11) / 12 * 12;
+    if (interval <= 0) {
+      interval = 12;
+    }
+    nbCandidates = 0;
+    for (int i = 0; i < 128 && i < nbNotes; i++) {
+      int note = root + i;
+      // make extra-sure we won't go out of bounds
+      if (note >= 0 && note < 128 && scale[note % 12]) {
+        candidates[nbCandidates] = note;
+        nbCandidates++;
+      }
+    }
+    for (int i = 0; i < 128; i++) {
+      int note = shift(i);
+      noteOffMap[i] = (note >= 0 && note < 128) ? note : -1;
+      candidateIndex[i] = -1;
+    }
+    for (unsigned int i = 0; i < nbCandidates; i++) {
+      candidateIndex[candidates[i]] = i;
+    }
+    rebuildNoteOn();
+    rebuildTransitions();
+  }
+
+  // melodic generator: one table per candidate to draw the next one, weights from interval and degree
+  // O(n^2) for n candidates, skipped with the uniform generator
+  void rebuildTransitions() {
+    if (!isChained() || nbCandidates == 0) {
+      return;
+    }
+    // weights only depend on distance and pitch class
+    float byInterval[128];
+    for (int i = 0; i < 128; i++) {
+      byInterval[i] = (i > generator.maxLeap || (i == 0 && generator.noRepeat)) ? 0 : intervalWeight(generator, i);
+    }
+    float byCandidate[128];
+    for (unsigned int j = 0; j < nbCandidates; j++) {
+      byCandidate[j] = degreeWeight(generator, candidates[j] - root);
+    }
+    start.build(byCandidate, nbCandidates);
+    float weights[128];
+    for (unsigned int i = 0; i < nbCandidates; i++) {
+      bool any = false;
+      for (unsigned int j = 0; j < nbCandidates; j++) {
+        const int interval = candidates[j] > candidates[i] ? candidates[j] - candidates[i] : candidates[i] - candidates[j];
+        weights[j] = byInterval[interval] * byCandidate[j];
+        any = any || weights[j] > 0;
+      }
+      // nothing within reach, e.g. gaps in the scale larger than max leap: closest other notes then
+      if (!any) {
+        nearest(i, weights);
+      }
+      transitions[i].build(weights, nbCandidates);
+    }
+  }
+
+  // weight 1 for the closest candidates other than this one (itself if alone), 0 otherwise
+  void nearest(unsigned int from, float *weights) const {
+    int closest = 128;
+    for (unsigned int j = 0; j < nbCandidates; j++) {
+      const int interval = candidates[j] > candidates[from] ? candidates[j] - candidates[from] : candidates[from] - candidates[j];
+      if (j != from && interval < closest) {
+        closest = interval;
+      }
+    }
+    for (unsigned int j = 0; j < nbCandidates; j++) {
+      const int interval = candidates[j] > candidates[from] ? candidates[j] - candidates[from] : candidates[from] - candidates[j];
+      weights[j] = (j != from && interval == closest) || (closest == 128 && j == from) ? 1 : 0;
+    }
+  }
+
+  // same as note off, filtering notes outside scale if option is set
+  void rebuildNoteOn() {
+    for (int i = 0; i < 128; i++) {
+      int note = noteOffMap[i];
+      noteOnMap[i] = (note >= 0 && (!shallNotPass || isInScale(note))) ? note : -1;
+    }
+  }
+
+  // settings used to build the tables
+  bool valid = false;
+  int root = 0;
+  int nbNotes = 0;
+  bool scale[12] = {false};
+  bool shallNotPass = false;
+  // number of notes rounded to next octave
+  int interval = 12;
+  // notes that can be drawn
+  uint8_t candidates[128];
+  unsigned int nbCandidates = 0;
+  // position of a note among candidates, -1 if not one
+  int8_t candidateIndex[128];
+  // melodic generator: first note, and next note from each candidate
+  GeneratorSettings generator;
+  AliasTable start;
+  AliasTable transitions[128];
+  // input note to shifted note, -1 to reject
+  int8_t noteOnMap[128];
+  int8_t noteOffMap[128];
+};
+
+#endif /* SIMON_LAYOUT_H */
@@ -0,0 +1,354 @@
+
+#ifndef SIMON_MELODY_H
+#define SIMON_MELODY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "SimonUtils.h"
+
+// memory mapping where available, whole file read at once otherwise (e.g. web)
+#if defined(_WIN32)
+#include <windows.h>
+#elif !defined(DISTRHO_OS_WASM)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SIMON_MELODY_MMAP 1
+#endif
+
+// line 0 is the highest note across tracks, line n the highest note of track n
+#define MELODY_NB_LINES (MELODY_MAX_TRACKS + 1)
+
+// one note per onset, as learnt round after round, with what the layout needs
+struct MelodyLine {
+  uint16_t nbNotes;
+  uint8_t low;
+  uint8_t high;
+  // pitch classes in use
+  bool scale[12];
+  uint8_t notes[MELODY_MAX_NOTES];
+};
+
+// longer paths are truncated in the copy kept along a melody
+#define MELODY_MAX_PATH 1024
+
+// every line of a file, parsed once off the audio thread -- fixed size so that it is exchanged without any allocation
+struct Melody {
+  MelodyLine lines[MELODY_NB_LINES];
+  // file it was read from, e.g. for capture
+  char path[MELODY_MAX_PATH];
+};
+
+// Read-only view of a whole file, nothing is copied when it can be mapped
+class MappedFile {
+
+ public:
+  MappedFile(const char *path) {
+#if defined(SIMON_MELODY_MMAP)
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+      void *map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        data = (const uint8_t *) map;
+        size = info.st_size;
+      }
+    }
+    // mapping stays valid once the descriptor is closed
+    close(fd);
+#elif defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      return;
+    }
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+      mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (mapping != nullptr) {
+        data = (const uint8_t *) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = data != nullptr ? fileSize.QuadPart : 0;
+      }
+    }
+    CloseHandle(file);
+#else
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+      return;
+    }
+    if (fseek(file, 0, SEEK_END) == 0) {
+      const long fileSize = ftell(file);
+      uint8_t *buffer = fileSize > 0 ? (uint8_t *) malloc(fileSize) : nullptr;
+      rewind(file);
+      if (buffer != nullptr && fread(buffer, 1, fileSize, file) == (size_t) fileSize) {
+        data = buffer;
+        size = fileSize;
+      }
+      else {
+        free(buffer);
+      }
+    }
+    fclose(file);
+#endif
+  }
+
+  ~MappedFile() {
+    if (data == nullptr) {
+      return;
+    }
+#if defined(SIMON_MELODY_MMAP)
+    munmap((void *) data, size);
+#elif defined(_WIN32)
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+#else
+    free((void *) data);
+#endif
+  }
+
+  // nullptr if the file could not be read or is empty
+  const uint8_t *getData() const {
+    return data;
+  }
+
+  size_t getSize() const {
+    return size;
+  }
+
+ private:
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+#if defined(_WIN32)
+  HANDLE mapping = nullptr;
+#endif
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+};
+
+// Big endian reads over a chunk of the file, in place. Past the end everything is 0 and the reader is marked as failed.
+class MidiReader {
+
+ public:
+  MidiReader(const uint8_t *pos, const uint8_t *end) : pos(pos), end(end) {}
+
+  uint8_t u8() {
+    if (pos >= end) {
+      failed = true;
+      return 0;
+    }
+    return *pos++;
+  }
+  uint16_t u16() {
+    const uint16_t high = u8();
+    return high << 8 | u8();
+  }
+  uint32_t u32() {
+    const uint32_t high = u16();
+    return high << 16 | u16();
+  }
+  // variable-length quantity, at most 4 bytes
+  uint32_t vlq() {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+      const uint8_t byte = u8();
+      value = value << 7 | (byte & 0x7F);
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+    failed = true;
+    return value;
+  }
+  void skip(uint32_t nbBytes) {
+    if (nbBytes > (size_t) (end - pos)) {
+      pos = end;
+      failed = true;
+      return;
+    }
+    pos += nbBytes;
+  }
+  // next byte without moving, 0 past the end
+  uint8_t peek() const {
+    return pos < end ? *pos : 0;
+  }
+
+  const uint8_t *getPos() const {
+    return pos;
+  }
+  bool atEnd() const {
+    return pos >= end;
+  }
+  bool ok() const {
+    return !failed;
+  }
+
+ private:
+  const uint8_t *pos;
+  const uint8_t *end;
+  bool failed = false;
+};
+
+// append a note on to a line being built, onsets in order. At the same onset only the highest note is kept.
+inline void addMelodyNote(MelodyLine &line, uint64_t &lastTick, uint64_t tick, uint8_t note) {
+  if (line.nbNotes > 0 && tick == lastTick) {
+    if (note > line.notes[line.nbNotes - 1]) {
+      line.notes[line.nbNotes - 1] = note;
+    }
+  }
+  else if (line.nbNotes < MELODY_MAX_NOTES) {
+    line.notes[line.nbNotes++] = note;
+    lastTick = tick;
+  }
+}
+
+// range and pitch classes, once notes are known
+inline void summarizeMelodyLine(MelodyLine &line) {
+  line.low = 127;
+  line.high = 0;
+  for (int i = 0; i < 12; i++) {
+    line.scale[i] = false;
+  }
+  for (int i = 0; i < line.nbNotes; i++) {
+    const uint8_t note = line.notes[i];
+    line.low = note < line.low ? note : line.low;
+    line.high = note > line.high ? note : line.high;
+    line.scale[note % 12] = true;
+  }
+  if (line.nbNotes == 0) {
+    line.low = line.high = 0;
+  }
+}
+
+// no note in any line
+inline void clearMelody(Melody &melody) {
+  for (int i = 0; i < MELODY_NB_LINES; i++) {
+    melody.lines[i].nbNotes = 0;
+    summarizeMelodyLine(melody.lines[i]);
+  }
+}
+
+// walk the events of one track, note ons go to its own line and, unless percussion, to the onsets of all tracks packed in scratch
+// note: running status is followed, sysex and meta events are skipped, a truncated track keeps what was read
+inline void parseMelodyTrack(MidiReader reader, MelodyLine *line, std::vector<uint64_t> &scratch) {
+  uint64_t tick = 0;
+  uint64_t lastTick = 0;
+  uint8_t running = 0;
+  while (reader.ok() && !reader.atEnd()) {
+    tick += reader.vlq();
+    if (!reader.ok()) {
+      return;
+    }
+    uint8_t status = reader.peek();
+    if (status & 0x80) {
+      reader.u8();
+    }
+    // data byte without running status, track is not usable beyond
+    else if (running == 0) {
+      return;
+    }
+    else {
+      status = running;
+    }
+    if (status == 0xFF) {
+      const uint8_t type = reader.u8();
+      reader.skip(reader.vlq());
+      // end of track
+      if (type == 0x2F) {
+        return;
+      }
+      continue;
+    }
+    if (status == 0xF0 || status == 0xF7) {
+      reader.skip(reader.vlq());
+      running = 0;
+      continue;
+    }
+    // other system messages have no place in a file
+    if (status > 0xF0) {
+      return;
+    }
+    running = status;
+    const uint8_t type = status & 0xF0;
+    const uint8_t data1 = reader.u8();
+    // program change and channel pressure have a single data byte
+    const uint8_t data2 = (type == 0xC0 || type == 0xD0) ? 0 : reader.u8();
+    if (type == 0x90 && data2 > 0 && reader.ok()) {
+      const uint8_t note = data1 & 0x7F;
+      if (line != nullptr) {
+        addMelodyNote(*line, lastTick, tick, note);
+      }
+      // channel 10 is for drums, not a melody
+      if ((status & 0x0F) != 9) {
+        // earliest first, then highest
+        scratch.push_back(tick << 7 | (127 - note));
+      }
+    }
+  }
+}
+
+// parse a whole Standard MIDI File in place, scratch is reused in-between calls
+// return false if this is not a MIDI file or it has no note at all, melody is then empty
+inline bool parseMelody(const uint8_t *data, size_t size, Melody &melody, std::vector<uint64_t> &scratch) {
+  clearMelody(melody);
+  scratch.clear();
+  const uint8_t *end = data + size;
+  MidiReader header(data, end);
+  if (size < 14 || header.u32() != 0x4D546864) {
+    return false;
+  }
+  const uint32_t headerLength = header.u32();
+  // format, number of tracks and division only matter to timings, notes are only ordered here
+  header.skip(headerLength);
+  if (!header.ok()) {
+    return false;
+  }
+  // chunks one after the other, unknown ones are skipped
+  const uint8_t *chunk = header.getPos();
+  int nbTracks = 0;
+  while (end - chunk >= 8) {
+    MidiReader reader(chunk, end);
+    const uint32_t id = reader.u32();
+    const uint32_t length = reader.u32();
+    const uint8_t *body = reader.getPos();
+    const uint8_t *bodyEnd = length > (size_t) (end - body) ? end : body + length;
+    if (id == 0x4D54726B) {
+      nbTracks++;
+      parseMelodyTrack(MidiReader(body, bodyEnd), nbTracks <= MELODY_MAX_TRACKS ? &melody.lines[nbTracks] : nullptr, scratch);
+    }
+    chunk = bodyEnd;
+  }
+  // highest note at each onset, across tracks
+  std::sort(scratch.begin(), scratch.end());
+  uint64_t lastTick = 0;
+  for (const uint64_t packed : scratch) {
+    if (melody.lines[0].nbNotes >= MELODY_MAX_NOTES && (packed >> 7) != lastTick) {
+      break;
+    }
+    addMelodyNote(melody.lines[0], lastTick, packed >> 7, 127 - (packed & 0x7F));
+  }
+  bool any = false;
+  for (int i = 0; i < MELODY_NB_LINES; i++) {
+    summarizeMelodyLine(melody.lines[i]);
+    any = any || melody.lines[i].nbNotes > 0;
+  }
+  return any;
+}
+
+// map the file then parse it, see parseMelody()
+inline bool loadMelody(const char *path, Melody &melody, std::vector<uint64_t> &scratch) {
+  MappedFile file(path);
+  if (file.getData() == nullptr) {
+    clearMelody(melody);
+    return false;
+  }
+  return parseMelody(file.getData(), file.getSize(), melody, scratch);
+}
+
+#endif /* SIMON_MELODY_H */
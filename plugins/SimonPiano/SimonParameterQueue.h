@@ -0,0 +1,134 @@
+
+#ifndef SIMON_PARAMETER_QUEUE_H
+#define SIMON_PARAMETER_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+#include "DistrhoPluginInfo.h"
+#include "SimonEvents.h"
+#include "SimonActiveNotes.h"
+
+// one call to setParameterValue()
+struct ParameterChange {
+  uint32_t index;
+  float value;
+};
+
+// how many changes can wait for next block before we only keep latest values
+#define PARAMETER_QUEUE_SIZE 256
+// blocks a group waits for its end before being applied anyway, e.g. if the host lost the marker
+#define PARAMETER_GROUP_MAX_WAIT 16
+
+// Parameter changes from host or UI, applied by the audio thread at the beginning of next block, in order.
+// Changes between kParameterGroup set to 1 and set back to 0 are applied in the same block, once all of them arrived.
+// No lock: audio side is wait-free, and writers never wait for each other, e.g. host automation delivered on the audio thread
+// while the UI goes through the host on another thread. If the queue is full (e.g. no processing for a while), only the latest value
+// of each parameter is kept until next block, and applied after the queue, whatever the groups.
+class ParameterQueue {
+
+ public:
+  ParameterQueue() {
+    for (uint32_t i = 0; i < kParameterCount; i++) {
+      latest[i].store(0);
+    }
+    for (uint32_t i = 0; i < nbOverflowWords; i++) {
+      overflow[i].store(0);
+    }
+  }
+
+  // host or UI side, from any thread
+  void write(uint32_t index, float value) {
+    if (index >= kParameterCount) {
+      return;
+    }
+    latest[index].store(value, std::memory_order_relaxed);
+    // once overflowed, everything goes to latest values until next block so that they stay newer than the queue
+    // bit before flag, so that the audio side sees it along
+    if (overflowed.load(std::memory_order_acquire) || !queue.push({index, value})) {
+      if (index != kParameterGroup) {
+        overflow[index / 32].fetch_or(1u << (index % 32), std::memory_order_release);
+      }
+      overflowed.store(true, std::memory_order_release);
+    }
+  }
+
+  // last value written, e.g. for the host to read it back before it is applied -- any of them if written at once from several threads
+  float read(uint32_t index) const {
+    if (index >= kParameterCount) {
+      return 0;
+    }
+    return latest[index].load(std::memory_order_relaxed);
+  }
+
+  // audio side: call apply(index, value) for every change in order, then for latest values of those that did not fit
+  // a group not complete yet is left for next block, along with what follows
+  template <typename F>
+  void consume(F apply) {
+    // a writer sets its bit before the flag: bits set too late for this block are seen along the flag in the next one, after its queue
+    const bool overflowing = overflowed.load(std::memory_order_acquire);
+    ParameterChange change;
+    while (queue.peek(0, change)) {
+      if (change.index == kParameterGroup) {
+        if (change.value != 0 && !overflowing && !isGroupComplete() && groupWait < PARAMETER_GROUP_MAX_WAIT) {
+          groupWait++;
+          return;
+        }
+        groupWait = 0;
+      }
+      else {
+        apply(change.index, change.value);
+      }
+      queue.pop(change);
+    }
+    // writers go back to the queue, from next block on
+    if (overflowing) {
+      overflowed.store(false, std::memory_order_release);
+      applyOverflow(apply);
+    }
+  }
+
+ private:
+  static const uint32_t nbOverflowWords = (kParameterCount + 31) / 32;
+  SharedRingBuffer<ParameterChange, PARAMETER_QUEUE_SIZE> queue;
+  std::atomic<float> latest[kParameterCount];
+  // parameters changed while queue was full, or since it was
+  std::atomic<uint32_t> overflow[nbOverflowWords];
+  std::atomic<bool> overflowed{false};
+  // blocks the group at the front of the queue has been waiting for its end
+  uint32_t groupWait = 0;
+
+  // end of the group at the front of the queue has arrived
+  bool isGroupComplete() const {
+    ParameterChange change;
+    for (uint32_t i = 1; queue.peek(i, change); i++) {
+      if (change.index == kParameterGroup && change.value == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // order of changes is lost, start goes last so that a game starts or stops with all the other values
+  template <typename F>
+  void applyOverflow(F apply) {
+    bool starting = false;
+    for (uint32_t i = 0; i < nbOverflowWords; i++) {
+      uint32_t bits = overflow[i].exchange(0, std::memory_order_acquire);
+      while (bits) {
+        const uint32_t index = i * 32 + lowestBit(bits);
+        if (index == kStart) {
+          starting = true;
+        }
+        else {
+          apply(index, latest[index].load(std::memory_order_relaxed));
+        }
+        bits &= bits - 1;
+      }
+    }
+    if (starting) {
+      apply(kStart, latest[kStart].load(std::memory_order_relaxed));
+    }
+  }
+};
+
+#endif /* SIMON_PARAMETER_QUEUE_H */
@@ -1,464 +1,488 @@
 
 #include "ExtendedPlugin.hpp"
 #include "SimonUtils.h"
+#include "SimonTimeline.h"
+#include "SimonLayout.h"
+#include "SimonActiveNotes.h"
+#include "SimonEvents.h"
+#include "SimonParameterQueue.h"
+#include "SimonCapture.h"
+#include "SimonState.h"
+#include "SimonExport.h"
+#include "SimonMelody.h"
+#include "SimonSynth.h"
+#include "SimonPitch.h"
 #include <time.h> 
+#include <math.h>
 
 START_NAMESPACE_DISTRHO
 
 
-// time in seconds between notes for instructions (and before first instruction)
-#define NOTE_INTERVAL 0.25
-// how long each note is held during instruction
-#define NOTE_DURATION 0.5
+// how far before a beat a deadline can be and still be snapped to it, in frames, to absorb rounding of timings
+#define SYNC_TOLERANCE 2
 
-// state for a feedback
-enum FeedbackStatus {
-  FB_STATUS_START, // start feedback
-  FB_STATUS_RUN, // let feedback handle its state
-  FB_STATUS_STOP // emergency stop
-};
+// notes detected in audio input within one block, and room for them along a busy block of events from the host
+#define DETECT_MAX_NOTES 256
+#define DETECT_MAX_EVENTS 2048
 
 class SimonPiano : public ExtendedPlugin {
 public:
   // Note: do not care with default values since we will sent all parameters upon init
-  SimonPiano() : ExtendedPlugin(kParameterCount, 0, 0) {
-    // randomize seed for our number generator
-    ran.srand(time(NULL));
-    // make sure to init all variables
-    reset();
+  SimonPiano() : ExtendedPlugin(kParameterCount, 0, kStateCount) {
+    // start from defaults
+    for (uint32_t i = 0; i < kParameterCount; i++) {
+      values[i] = params[i].def;
+    }
+    // randomize seed for our number generators, unless imposed e.g. for a replay
+    if (!CaptureWriter::seedFromEnvironment(seed)) {
+      seed = time(NULL);
+    }
+    for (int lane = 0; lane < MAX_LANES; lane++) {
+      for (int i = 0; i < 128; i++) {
+        lanes.lastNoteOn[lane][i] = NEVER;
+      }
+      // first lane draws the same sequence as a single player would
+      lanes.ran[lane].srand(seed + lane);
+      lanes.status[lane] = params[kStatus].def;
+      lanes.curNote[lane] = params[kCurNote].def;
+      lanes.curChannel[lane] = 0;
+      lanes.lastOnset[lane] = -1;
+      lanes.nbTimings[lane] = 0;
+      lanes.sumTimings[lane] = 0;
+      lanes.sumSqTimings[lane] = 0;
+      // make sure to init all variables
+      reset(lane);
+    }
+    // timings in frames
+    sampleRateChanged(getSampleRate());
+    // notes in use, until first sync
+    layout.update(effectiveRoot, effectiveNbNotes, effectiveScale);
+    layout.setGenerator(generatorSettings());
+    layout.setShallNotPass(shallNotPass);
+    synth.setVolume(synthVolume);
+    detector.setHop(audioHop);
+    detector.setGate(audioGate);
+    // stream of events toward the UI, if any left
+    events = GameEventStreams::acquire(eventsId);
+    values[kEventStream] = eventsId;
+    publishOutputs();
+    // something to give to the host before first block
+    saveSession();
+    // record all inputs, if asked, files are told apart by instance
+    const uint32_t instanceId = newInstanceId();
+    capture = CaptureWriter::fromEnvironment(getSampleRate(), getBufferSize(), seed, instanceId);
+    // each game to a MIDI file, if asked
+    midiExport = MidiExportWriter::fromEnvironment(instanceId);
+  }
+
+  ~SimonPiano() override {
+    GameEventStreams::release(eventsId);
+    delete capture;
+    delete midiExport;
   }
 
 protected:
   // metadata
-  const char *getLabel() const override { return "SimonPiano"; }
+  const char *getLabel() const override { return DISTRHO_PLUGIN_NAME; }
   const char *getDescription() const override {
     return "Follow the lead, play after me";
   }
   const char *getMaker() const override { return "jfrey"; }
   uint32_t getVersion() const override { return d_version(1,0,0); }
   int64_t getUniqueId() const override { 
+#if defined(SIMON_PIANO_AUDIO) && !defined(DISTRHO_OS_WASM)
+    return d_cconst('S','I','P','A');
+#else
     return d_cconst('S','I','P','I'); 
+#endif
   }
   
-  // params
+  // params, all described in a table shared with UI
   void initParameter (uint32_t index, Parameter& parameter) override {
+    if (index >= kParameterCount) {
+      return;
+    }
+    parameter.hints = params[index].hints;
+    parameter.name = params[index].name;
+    parameter.shortName = params[index].shortName;
+    parameter.symbol = params[index].symbol;
+    parameter.unit = params[index].unit;
+    parameter.ranges.def = params[index].def;
+    parameter.ranges.min = params[index].min;
+    parameter.ranges.max = params[index].max;
 
-    switch (index) {
-    case kStart:
-      // must go from false to true during WAITING state to take effect
-      parameter.hints = kParameterIsAutomatable|kParameterIsBoolean;
-      parameter.name = "Start new round";
-      parameter.shortName = "start";
-      parameter.symbol = "start";
-      parameter.unit = "";
-      parameter.ranges.def = params[kStart].def;
-      parameter.ranges.min = params[kStart].min;
-      parameter.ranges.max = params[kStart].max;
-      break;
-    case kRoot:
-      parameter.hints = kParameterIsInteger | kParameterIsAutomatable;
-      parameter.name = "Output root note";
-      parameter.shortName = "root";
-      parameter.symbol = "rootnote";
-      parameter.unit = "";
-      parameter.ranges.def = params[kRoot].def;
-      parameter.ranges.min = params[kRoot].min;
-      parameter.ranges.max = params[kRoot].max;
-      break;
-    case kNbNotes:
-      parameter.hints = kParameterIsInteger | kParameterIsAutomatable;
-      parameter.name = "Number of notes";
-      parameter.shortName = "nb notes";
-      parameter.symbol = "nbnotes";
-      parameter.unit = "notes";
-      parameter.ranges.def = params[kNbNotes].def;
-      parameter.ranges.min = params[kNbNotes].min;
-      parameter.ranges.max = params[kNbNotes].max;
-      break;
-    case kScaleC:
-    case kScaleCs:
-    case kScaleD:
-    case kScaleDs:
-    case kScaleE:
-    case kScaleF:
-    case kScaleFs:
-    case kScaleG:
-    case kScaleGs:
-    case kScaleA:
-    case kScaleAs:
-    case kScaleB:
-      parameter.hints = kParameterIsAutomatable|kParameterIsBoolean;
-      {
-        // we will do our bet to make that a tiny bit less tedious
-        int numScale = index - kScaleC;
-        if (numScale >= 0 && numScale < 12) {
-          parameter.name = scaleNotes[numScale];
-          parameter.shortName = scaleNotes[numScale];
-          parameter.symbol = scaleNotesSymbols[numScale];
-        }
-      }
-      parameter.unit = "";
-      parameter.ranges.def = params[index].def;
-      parameter.ranges.min = params[index].min;
-      parameter.ranges.max = params[index].max;
-      break;
-    case kShallNotPass:
-      // notes outside scale are not take into account
-      parameter.hints = kParameterIsAutomatable|kParameterIsBoolean;
-      parameter.name = "Shall not pass";
-      parameter.shortName = "no pass";
-      parameter.symbol = "shallnotpass";
-      parameter.unit = "";
-      parameter.ranges.def = params[index].def;
-      parameter.ranges.min = params[index].min;
-      parameter.ranges.max = params[index].max;
-      break;
+    // effectively set parameter
+    setParameterValue(index, parameter.ranges.def);
+  }
 
-    case kRoundsForMiss:
-      // how many rounds to grant a new miss. 0 to disable.
-      parameter.hints = kParameterIsInteger | kParameterIsAutomatable;
-      parameter.name = "Rounds to grant a miss";
-      parameter.shortName = "rnd f mis";
-      parameter.symbol = "roundsformiss";
-      parameter.unit = "rounds";
-      parameter.ranges.def = params[index].def;
-      parameter.ranges.min = params[index].min;
-      parameter.ranges.max = params[index].max;
-      break;
-    case kEffectiveRoot:
-      parameter.hints = kParameterIsInteger | kParameterIsOutput;
-      parameter.name = "Effective root";
-      parameter.shortName = "eff root";
-      parameter.symbol = "effectiveroot";
-      parameter.unit = "";
-      parameter.ranges.def = params[kEffectiveRoot].def;
-      parameter.ranges.min = params[kEffectiveRoot].min;
-      parameter.ranges.max = params[kEffectiveRoot].max;
-      break;
-    case kEffectiveNbNotes:
-      parameter.hints = kParameterIsInteger | kParameterIsOutput;
-      parameter.name = "Effective number of notes";
-      parameter.shortName = "eff nbnotes";
-      parameter.symbol = "effectivenbroot";
-      parameter.unit = "notes";
-      parameter.ranges.def = params[kEffectiveNbNotes].def;
-      parameter.ranges.min = params[kEffectiveNbNotes].min;
-      parameter.ranges.max = params[kEffectiveNbNotes].max;
-      break;
-    case kStatus:
-      // used to pass to UI what general status and current note is about
-      parameter.hints = kParameterIsInteger | kParameterIsOutput;
-      parameter.name = "Status";
-      parameter.shortName = "stat";
-      parameter.symbol = "status";
-      parameter.unit = "";
-      parameter.ranges.def = params[kStatus].def;
-      parameter.ranges.min = params[kStatus].min;
-      parameter.ranges.max = params[kStatus].max;
-      break;
-    case kCurNote:
-      // used to pass to UI current active note
-      parameter.hints = kParameterIsInteger | kParameterIsOutput;
-      parameter.name = "Current active note";
-      parameter.shortName = "note";
-      parameter.symbol = "curnote";
-      parameter.unit = "";
-      parameter.ranges.def = params[kCurNote].def;
-      parameter.ranges.min = params[kCurNote].min;
-      parameter.ranges.max = params[kCurNote].max;
-      break;
-    case kRound:
-      // what round we are at
-      parameter.hints = kParameterIsInteger | kParameterIsOutput;
-      parameter.name = "Round number";
-      parameter.shortName = "round";
-      parameter.symbol = "round";
-      parameter.unit = "round";
-      parameter.ranges.def = params[kRound].def;
-      parameter.ranges.min = params[kRound].min;
-      parameter.ranges.max = params[kRound].max;
-      break;
-    case kStep:
-      // what step we are at
-      parameter.hints = kParameterIsInteger | kParameterIsOutput;
-      parameter.name = "Step number";
-      parameter.shortName = "step";
-      parameter.symbol = "step";
-      parameter.unit = "step";
-      parameter.ranges.def = params[kStep].def;
-      parameter.ranges.min = params[kStep].min;
-      parameter.ranges.max = params[kStep].max;
-      break;
-    case kEffectiveScaleC:
-    case kEffectiveScaleCs:
-    case kEffectiveScaleD:
-    case kEffectiveScaleDs:
-    case kEffectiveScaleE:
-    case kEffectiveScaleF:
-    case kEffectiveScaleFs:
-    case kEffectiveScaleG:
-    case kEffectiveScaleGs:
-    case kEffectiveScaleA:
-    case kEffectiveScaleAs:
-    case kEffectiveScaleB:
-      parameter.hints = kParameterIsBoolean | kParameterIsOutput;
-      {
-          // we will do our bet to make that a tiny bit less tedious
-        int numScale = index - kEffectiveScaleC;
-        if (numScale >= 0 && numScale < 12) {
-          parameter.name = String("Effective ") + scaleNotes[numScale];
-          parameter.shortName = String("eff ") + scaleNotes[numScale];
-          parameter.symbol = String("effective") + scaleNotesSymbols[numScale];
-          }
-      }
-      parameter.unit = "";
-      parameter.ranges.def = params[index].def;
-      parameter.ranges.min = params[index].min;
-      parameter.ranges.max = params[index].max;
-      break;
-    case kNbMiss:
-      parameter.hints = kParameterIsInteger | kParameterIsOutput;
-      parameter.name = "Number of miss";
-      parameter.shortName = "nb miss";
-      parameter.symbol = "nbmiss";
-      parameter.unit = "miss";
-      parameter.ranges.def = params[index].def;
-      parameter.ranges.min = params[index].min;
-      parameter.ranges.max = params[index].max;
-      break;
-    case kMaxMiss:
-      parameter.hints = kParameterIsInteger | kParameterIsOutput;
-      parameter.name = "Max number of miss";
-      parameter.shortName = "max miss";
-      parameter.symbol = "maxmiss";
-      parameter.unit = "miss";
-      parameter.ranges.def = params[index].def;
-      parameter.ranges.min = params[index].min;
-      parameter.ranges.max = params[index].max;
+  // one blob for the whole session, not needed by the UI, and the file of the melody, picked by host or UI
+  void initState(uint32_t index, State &state) override {
+    switch (index) {
+    case kStateSession:
+      state.key = STATE_KEY;
+      state.defaultValue = "";
+      state.label = "Session";
+      state.hints = kStateIsOnlyForDSP | kStateIsBase64Blob;
       break;
-    case kMaxRound:
-      parameter.hints = kParameterIsInteger | kParameterIsOutput;
-      parameter.name = "Max round reached";
-      parameter.shortName = "max round";
-      parameter.symbol = "maxround";
-      parameter.unit = "rounds";
-      parameter.ranges.def = params[index].def;
-      parameter.ranges.min = params[index].min;
-      parameter.ranges.max = params[index].max;
+    case kStateMelody:
+      state.key = MELODY_KEY;
+      state.defaultValue = "";
+      state.label = "Melody";
+      state.hints = kStateIsFilenamePath;
       break;
-
     default:
       break;
     }
-    
-    // effectively set parameter
-    setParameterValue(index, parameter.ranges.def);
   }
 
-  float getParameterValue(uint32_t index) const override {
-    switch (index) {
+  // called by the host, e.g. upon saving project: last snapshot from the audio thread, see saveSession()
+  String getState(const char *key) const override {
+    if (strcmp(key, MELODY_KEY) == 0) {
+      return melodyPath;
+    }
+    if (strcmp(key, STATE_KEY) != 0) {
+      return String();
+    }
+    sessions.fetch();
+    uint8_t blob[STATE_MAX_SIZE];
+    char text[STATE_MAX_TEXT];
+    encodeBase64(blob, writeSession(sessions.front(), blob), text);
+    return String(text);
+  }
 
-    case kStart:
-      return start;
-    case kRoot:
-      return root;
-    case kNbNotes:
-      return nbNotes;
-    case kScaleC:
-    case kScaleCs:
-    case kScaleD:
-    case kScaleDs:
-    case kScaleE:
-    case kScaleF:
-    case kScaleFs:
-    case kScaleG:
-    case kScaleGs:
-    case kScaleA:
-    case kScaleAs:
-    case kScaleB:
-      {
-        int numScale = index - kScaleC;
-        if (numScale >= 0 && numScale < 12) {
-          return scale[index];
-        }
-      }
-      return 0.9;
-    case kShallNotPass:
-      return shallNotPass;
-    case kRoundsForMiss:
-      return roundsForMiss;
-    case kEffectiveRoot:
-      return effectiveRoot;
-    case kEffectiveNbNotes:
-      return effectiveNbNotes;
-    case kStatus:
-      return status;
-    case kCurNote:
-      return curNote;
-    case kRound:
-      return round;
-    case kStep:
-      return stepN;
-    case kEffectiveScaleC:
-    case kEffectiveScaleCs:
-    case kEffectiveScaleD:
-    case kEffectiveScaleDs:
-    case kEffectiveScaleE:
-    case kEffectiveScaleF:
-    case kEffectiveScaleFs:
-    case kEffectiveScaleG:
-    case kEffectiveScaleGs:
-    case kEffectiveScaleA:
-    case kEffectiveScaleAs:
-    case kEffectiveScaleB:
-      {
-        int numScale = index - kEffectiveScaleC;
-        if (numScale >= 0 && numScale < 12) {
-          return effectiveScale[numScale];
-        }
+  // called by the host, e.g. upon loading project: decoded here, applied at the beginning of next block
+  // note: an invalid or empty blob (default value) is ignored
+  // a melody is parsed right away, see loadMelody(), empty path or invalid file leave no melody to learn
+  void setState(const char *key, const char *value) override {
+    if (value == nullptr) {
+      return;
+    }
+    if (strcmp(key, MELODY_KEY) == 0) {
+      melodyPath = value;
+      if (value[0] == '\0' || !loadMelody(value, melodies.back(), melodyScratch)) {
+        clearMelody(melodies.back());
       }
-      return 0.9;
-    case kNbMiss:
-      return nbMiss;
-    case kMaxMiss:
-      return maxMiss;
-    case kMaxRound:
-      return maxRound;
+      snprintf(melodies.back().path, sizeof(melodies.back().path), "%s", value);
+      melodies.publish();
+      return;
+    }
+    if (strcmp(key, STATE_KEY) != 0) {
+      return;
+    }
+    uint8_t blob[STATE_MAX_SIZE];
+    const int size = decodeBase64(value, blob, sizeof(blob));
+    if (size > 0 && readSession(blob, size, restoredSessions.back())) {
+      restoredSessions.publish();
+    }
+  }
 
-    default:
+  float getParameterValue(uint32_t index) const override {
+    if (index >= kParameterCount) {
       return 0.0;
     }
+    // input parameters: last value set, even if not applied yet
+    if (!isParameterOutput(index)) {
+      return parameters.read(index);
+    }
+    return values[index];
   }
-  
+
+  // might be called from another thread than process(), changes are queued and applied at the beginning of next block
   void setParameterValue(uint32_t index, float value) override {
-    switch (index) {
-    case kStart:
+    parameters.write(index, value);
+  }
+
+  // effectively apply a parameter change, from the audio thread
+  void applyParameter(uint32_t index, float value) {
+    // outputs are only changed by us
+    if (index >= kParameterCount || isParameterOutput(index)) {
+      return;
+    }
+    int newValue = value;
+    if (params[index].hints & kParameterIsBoolean) {
+      newValue = (value != 0);
+    }
+    if (index == kStart && newValue != start) {
       // effectively start if waiting for it
-      if (value != start) {
-        // effectively start if waiting for it
-        if (value && !isRunning(status)) {
-          newGame();
-        }
-        // un-start: stopping the game
-        else if (!value && isRunning(status)) {
-          stop();
-        }
+      if (newValue && !anyRunning()) {
+        newGame();
       }
-      start = value;
-      break;
-    case kRoot:
-      root = value;
-      break;
-    case kNbNotes:
-      nbNotes = value;
-      break;
-    case kScaleC:
-    case kScaleCs:
-    case kScaleD:
-    case kScaleDs:
-    case kScaleE:
-    case kScaleF:
-    case kScaleFs:
-    case kScaleG:
-    case kScaleGs:
-    case kScaleA:
-    case kScaleAs:
-    case kScaleB:
-      {
-        int numScale = index - kScaleC;
-        if (numScale >= 0 && numScale < 12) {
-          scale[numScale] = value;
+      // un-start: stopping the games still running
+      else if (!newValue && anyRunning()) {
+        for (int lane = 0; lane < effectiveNbLanes; lane++) {
+          if (isRunning(lanes.status[lane])) {
+            stop(lane);
+          }
         }
       }
-      break;
-    case kShallNotPass:
-      shallNotPass = value;
-      break;
-    case kRoundsForMiss:
-      roundsForMiss = value;
-      break;
-    case kEffectiveRoot:
-      effectiveRoot = value;
-      break;
-    case kEffectiveNbNotes:
-      effectiveNbNotes = value;
-      break;
-    case kCurNote:
-      curNote = value;
-      break;
+    }
+    values[index] = newValue;
+    if (index == kDebounce) {
+      updateDebounce();
+    }
+    // what is sounding fades out
+    if (index == kSynth && !builtInSynth) {
+      synth.releaseAll();
+    }
+    if (index == kSynthVolume) {
+      synth.setVolume(synthVolume);
+    }
+    if (index == kAudioHop) {
+      detector.setHop(audioHop);
+    }
+    if (index == kAudioGate) {
+      detector.setGate(audioGate);
+    }
+    // schedule is fixed during a game, otherwise follow changes to show the tempo
+    if ((index == kInterval || index == kDuration || index == kCurve || index == kSpeedUp) && !anyRunning()) {
+      compileSchedule();
+      updateAllTimings();
+    }
+  }
+
+  // send note on, keeping track of it
+  // frame: frame of the event in the buffer
+  void playNote(uint8_t note, uint8_t velocity, uint8_t channel, uint32_t frame) {
+    forwardEvents(frame);
+    activeNotes.on(note, channel);
+    sendNoteOn(note, velocity, channel, frame);
+    if (builtInSynth) {
+      synth.noteOn(note, velocity, channel, frame);
+    }
+  }
 
+  // note off downstream and to the built-in synth
+  // frame: frame of the event in the buffer
+  void sendRelease(uint8_t note, uint8_t channel, uint32_t frame) {
+    sendNoteOff(note, channel, frame);
+    synth.noteOff(note, channel, frame);
+  }
+
+  // send note off, only if we did send a note on before
+  // frame: frame of the event in the buffer
+  void releaseNote(uint8_t note, uint8_t channel, uint32_t frame) {
+    if (activeNotes.off(note, channel)) {
+      forwardEvents(frame);
+      sendRelease(note, channel, frame);
+    }
+  }
+
+  // turning off every note we are responsible for, including current one
+  // frame: frame of the event in the buffer
+  void releaseAllNotes(uint32_t frame=0) {
+    forwardEvents(frame);
+    activeNotes.flush([this, frame](uint8_t note, uint8_t channel) {
+      sendRelease(note, channel, frame);
+    });
+    for (int lane = 0; lane < MAX_LANES; lane++) {
+      lanes.curNote[lane] = -1;
+    }
+  }
+
+  // turning off every note of a player, i.e. of its channel -- any channel goes with a single player
+  // frame: frame of the event in the buffer
+  void releaseLane(int lane, uint32_t frame=0) {
+    if (effectiveNbLanes <= 1) {
+      releaseAllNotes(frame);
+      return;
+    }
+    forwardEvents(frame);
+    activeNotes.flushChannel(lane, [this, frame](uint8_t note, uint8_t channel) {
+      sendRelease(note, channel, frame);
+    });
+    lanes.curNote[lane] = -1;
+  }
+
+  // player listening to this channel, -1 if none -- with a single player every channel goes to the first lane
+  int laneOf(uint8_t channel) const {
+    if (effectiveNbLanes <= 1) {
+      return 0;
+    }
+    return channel < effectiveNbLanes ? channel : -1;
+  }
+
+  // at least one game in progress
+  bool anyRunning() const {
+    for (int lane = 0; lane < effectiveNbLanes; lane++) {
+      if (isRunning(lanes.status[lane])) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // number of players from parameter, only changed in-between games
+  int clampedNbLanes() const {
+    return nbLanes < 1 ? 1 : nbLanes > MAX_LANES ? MAX_LANES : nbLanes;
+  }
+
+  // apply number of players, the ones left out are shown as waiting -- their outputs are not updated anymore
+  void updateNbLanes(int nb) {
+    effectiveNbLanes = nb;
+    sessionChanged = true;
+    for (int lane = effectiveNbLanes; lane < MAX_LANES; lane++) {
+      reset(lane);
+      lanes.status[lane] = WAITING;
+      values[laneParameter(lane, LANE_STATUS)] = WAITING;
+      values[laneParameter(lane, LANE_ROUND)] = 0;
+      values[laneParameter(lane, LANE_MISS)] = 0;
+    }
+  }
+
+  // note on / note off, handled by ExtendedPlugin callbacks
+  static bool isNoteEvent(const MidiEvent &event) {
+    const uint8_t status = event.data[0] & 0xF0;
+    return event.size >= 3 && event.size <= MidiEvent::kDataSize && (status == 0x80 || status == 0x90);
+  }
+
+  // kind of message as in PassThrough
+  static int passThroughType(const MidiEvent &event) {
+    const uint8_t *data = event.size > MidiEvent::kDataSize ? event.dataExt : event.data;
+    if (event.size == 0 || data == nullptr) {
+      return 0;
+    }
+    switch (data[0] & 0xF0) {
+    case 0xA0:
+      return PASS_POLY_PRESSURE;
+    case 0xB0:
+      return PASS_CONTROL;
+    case 0xC0:
+      return PASS_PROGRAM;
+    case 0xD0:
+      return PASS_CHANNEL_PRESSURE;
+    case 0xE0:
+      return PASS_BEND;
+    case 0xF0:
+      return PASS_SYSTEM;
     default:
-      break;
+      return 0;
     }
   }
 
-  // turning off current note
+  // forward incoming messages that are not notes, before this frame in the buffer -- our own notes at the same frame go first
+  // stops at the next note event, whose callback will skip it, so that everything is sent in the same order as received
+  // note: the event from the host is given as-is to the output, including external data of sysex
+  void forwardEvents(uint32_t end) {
+    while (nextEvent < nbBlockEvents && blockEvents[nextEvent].frame < end && !isNoteEvent(blockEvents[nextEvent])) {
+      if (passThroughType(blockEvents[nextEvent]) & passThrough) {
+        writeMidiEvent(blockEvents[nextEvent]);
+      }
+      nextEvent++;
+    }
+  }
+
+  // from a note callback, forward what came before this note in the buffer, including at the same frame, and move past it
+  void reachNoteEvent(uint32_t frame) {
+    forwardEvents(frame + 1);
+    if (nextEvent < nbBlockEvents && isNoteEvent(blockEvents[nextEvent])) {
+      nextEvent++;
+    }
+  }
+
+  // turning off current note of this player
   // frame: frame of the event in the buffer
-  void abortCurrentNote(uint32_t frame=0) {
-    if (curNote >= 0) {
-      sendNoteOff(curNote, curChannel, frame);
-      curNote = -1;
+  void abortCurrentNote(int lane, uint32_t frame=0) {
+    if (lanes.curNote[lane] >= 0) {
+      releaseNote(lanes.curNote[lane], lanes.curChannel[lane], frame);
+      lanes.curNote[lane] = -1;
     }
   }
 
-  // shift input, considering the current root note and the interval (number of notes) on interest
-  int shiftNote(int note) {
-    // round number of notes to next octave
-    int interval = ceil(effectiveNbNotes / (float) 12) * 12;
-    // we seek position in interval
-    note = (note - effectiveRoot) % interval;
-    // % is remainder in C, not modulo, adapt
-    if (note < 0) {
-      note += interval;
+  // check note on against last one for the same input note of the same player, whatever the channel
+  // note: only note on are filtered, note off of a note that is not sounding are harmless
+  bool isBouncing(int lane, uint8_t note, uint32_t frame) {
+    note &= 0x7F;
+    const uint64_t eventFrame = blockFrame + frame;
+    uint64_t &last = lanes.lastNoteOn[lane][note];
+    if (debounceFrames > 0 && last != NEVER && eventFrame - last < debounceFrames) {
+      nbFiltered++;
+      return true;
     }
-    // shift back compared to root
-    return note + effectiveRoot;
+    last = eventFrame;
+    return false;
+  }
+
+  // debounce window in frames, upon change of parameter or sample rate
+  void updateDebounce() {
+    debounceFrames = debounce * sampleRate / 1000 + 0.5;
   }
 
   // user playing notes, shifting note to interval of interest.  keep channel and velocity for user during pass-through
   void noteOn(uint8_t note, uint8_t velocity, uint8_t channel, uint32_t frame) override {
+    reachNoteEvent(frame);
+    // nobody plays on this channel
+    const int lane = laneOf(channel);
+    if (lane < 0 || isBouncing(lane, note, frame)) {
+      return;
+    }
     // Tries to be as smart as possible, if the input note is out of range consider that the position is just shifted (user might not have the correct octave configured)
-    note = shiftNote(note); 
-
-    // ignore the note if option set and out of range
-    if (shallNotPass && !effectiveScale[note % 12]) {
+    // also ignore the note if option set and out of range -- all precomputed in layout
+    int shifted = layout.remapNoteOn(note);
+    if (shifted < 0) {
       return;
     }
+    note = shifted;
+    int &status = lanes.status[lane];
+    int &curNote = lanes.curNote[lane];
+    int &stepN = lanes.stepN[lane];
+    if (isRunning(status)) {
+      exportNote(EXPORT_PLAYER, 0x90 | channel, note, velocity, frame);
+    }
     
     // while the game is not running we can hit notes to try-out
     if (!isRunning(status)) {
       // disable any currently playing note -- i.e. monophonic
-      abortCurrentNote(frame);
-      sendNoteOn(note, velocity, channel, frame);
+      abortCurrentNote(lane, frame);
+      playNote(note, velocity, channel, frame);
       curNote = note;
-      curChannel = channel;
+      lanes.curChannel[lane] = channel;
     }
     // only pass through during playing until last note, keep all info
-    else if (isPlaying(status) && (int) stepN < round) {
+    else if (isPlaying(status) && stepN < lanes.round[lane]) {
       // disable any currently playing note -- i.e. monophonic
       if (curNote >= 0) {
-        sendNoteOff(curNote, channel, frame);
+        releaseNote(curNote, lanes.curChannel[lane], frame);
       }
-      sendNoteOn(note, velocity, channel, frame);
+      playNote(note, velocity, channel, frame);
       curNote = note;
-      curChannel = channel;
-      if (stepN < MAX_ROUND && curNote == sequence[stepN]) {
-        status = PLAYING_CORRECT;
+      lanes.curChannel[lane] = channel;
+      if (curNote == noteAt(lane, stepN)) {
+        // a note out of rhythm still moves on, but counts as a miss
+        status = scoreOnset(lane, frame) ? PLAYING_CORRECT : PLAYING_INCORRECT;
         stepN++;
       }
       else {
         status = PLAYING_INCORRECT;
-        nbMiss++;
       }
-    }      
+      if (status == PLAYING_INCORRECT) {
+        lanes.nbMiss[lane]++;
+        sessionChanged = true;
+        // rhythm starts over from next note
+        lanes.lastOnset[lane] = -1;
+      }
+    }
+    publishEvents(frame);
   }
 
   // will detect new round upon note off of last playing
   void noteOff(uint8_t note, uint8_t channel, uint32_t frame) override {
+    reachNoteEvent(frame);
+    const int lane = laneOf(channel);
+    if (lane < 0) {
+      return;
+    }
     // shift here is well
-    note = shiftNote(note);
-
     // NOTE: even if note on were filtered with shallNotPass, process everything here, we could well have a note off event after the option was switched on
+    int shifted = layout.remapNoteOff(note);
+    if (shifted < 0) {
+      return;
+    }
+    note = shifted;
+    int &status = lanes.status[lane];
+    int &curNote = lanes.curNote[lane];
+    if (isRunning(status)) {
+      exportNote(EXPORT_PLAYER, 0x80 | channel, note, 0, frame);
+    }
 
     // do not change status in-between games, just pass-through note off events
     if (!isRunning(status)) {
@@ -466,353 +490,1024 @@ protected:
       // since we are monophonic, only consider note off of current 
       if (note == curNote) {
         curNote = -1;
-        sendNoteOff(note, channel, frame);
+        releaseNote(note, channel, frame);
       }
     }
     // while playing check if round is over
     else if (isPlaying(status)) {
-      sendNoteOff(note, channel, frame);
+      releaseNote(note, channel, frame);
       // take into account for play only if we turn off current note (we might also release part of a chord)
       if (note == curNote) {
         // user just hit an error, going to feedback mode
         if (status == PLAYING_INCORRECT) {
-          feedbackIncorrect(FB_STATUS_START, frame);
+          feedbackIncorrect(lane, frame);
         }
         // still in play, either next or new round
         else {
           status = PLAYING_WAIT;
           // time for new round
-          if ((int) stepN >= round) {
-            newRound();
+          if (lanes.stepN[lane] >= lanes.round[lane]) {
+            newRound(lane);
           }
         }
         curNote = -1;
       }
     }
+    publishEvents(frame);
   }
 
+  // one game per player, all with the same layout and timings
   void newGame() {
-    // we prevent starting if the entire scale is disabled
-    bool isScale = false;
-    for (int i = 0; i < 12; i++) {
-      if (effectiveScale[i]) {
-        isScale = true;
+    // we prevent starting if the entire scale is disabled, or if there is no melody to learn
+    if (layout.hasScale() && (!melodyMode || melodyLine != nullptr)) {
+      // number of players is fixed for the whole game, notes left on a channel that is not ours anymore are released next block
+      if (effectiveNbLanes != clampedNbLanes()) {
+        updateNbLanes(clampedNbLanes());
+        releasing = releasing || activeNotes.any();
+      }
+      // timings of all rounds
+      compileSchedule();
+      for (int lane = 0; lane < effectiveNbLanes; lane++) {
+        newGame(lane);
+      }
+      // one file for all players, until the last one is over
+      if (midiExport != nullptr) {
+        midiExport->gameStart(secondsAt(curFrame));
+        exporting = true;
       }
     }
-    if (isScale) {
-      reset();
-      status = STARTING;
-      // reset counters
-      lastTime = curTime;
-      round = 0;
+  }
+
+  void newGame(int lane) {
+    reset(lane);
+    // same seed, same game -- for every player
+    if (gameSeed > 0) {
+      lanes.ran[lane].srand(gameSeed);
     }
+    // notes beyond MAX_ROUND are derived from it
+    lanes.gameKey[lane] = ((uint64_t) lanes.ran[lane].next() << 32) | lanes.ran[lane].next();
+    updateTimings(lane);
+    // no more drawing once game started, a melody is known in advance anyway
+    if (pregenerate && melodyLine == nullptr) {
+      for (int i = 0; i < MAX_ROUND; i++) {
+        lanes.sequence[lane][i] = layout.drawNext(i > 0 ? lanes.sequence[lane][i - 1] : -1, lanes.ran[lane]);
+      }
+    }
+    lanes.status[lane] = STARTING;
+    lanes.round[lane] = 0;
+    sessionChanged = true;
+    // pause before first round
+    lanes.timeline[lane].clear();
+    lanes.timeline[lane].push(curFrame + lanes.noteInterval[lane], TL_NEW_ROUND);
   }
 
   // starting new instructions
-  void newRound() {
+  void newRound(int lane) {
     // here curNote set to -1 instead of newGame and reset, to be called within run() and have MIDI sent
-    abortCurrentNote();
-    status = INSTRUCTIONS;
-    stepN = 0;
+    abortCurrentNote(lane);
+    lanes.status[lane] = INSTRUCTIONS;
+    lanes.stepN[lane] = 0;
+    // new rhythm to follow
+    lanes.lastOnset[lane] = -1;
+    lanes.nbTimings[lane] = 0;
+    lanes.sumTimings[lane] = 0;
+    lanes.sumSqTimings[lane] = 0;
     // draw another note
-    addNote();
-    // reset counters
-    lastTime = curTime;
+    addNote(lane);
     // check if we should grant a new miss
-    if (roundsForMiss > 0 && round - lastRFM >= roundsForMiss) {
-      lastRFM = round;
-      maxMiss++;
+    if (roundsForMiss > 0 && lanes.round[lane] - lanes.lastRFM[lane] >= roundsForMiss) {
+      lanes.lastRFM[lane] = lanes.round[lane];
+      lanes.maxMiss[lane]++;
     }
     // increase round last, sequence < round
-    round++;
-  }
-
-  // draw another note to the sequence
-  void addNote() {
-    if (round >= MAX_ROUND) {
-      stop();
-    }
-    else if (round >= 0) {
-      // brute-force the possible notes considering root, number of notes, scale
-      int activeNotes[128] = {0};
-      int nbActives = 0;
-      for (int i = 0; i < 128 && i < effectiveNbNotes; i++) {
-        int note = effectiveRoot + i;
-        // make extra-sure we won't go out of bounds
-        if ((note % 12) >= 0 and effectiveScale[note % 12]) {
-          activeNotes[nbActives] = note;
-          nbActives++;
-        }
-      }
-      if (nbActives > 0) {
-        sequence[round] = activeNotes[ran.rand() % nbActives];
-      }
-      // fallback: root
-      else {
-        sequence[round] = effectiveRoot;
+    lanes.round[lane]++;
+    sessionChanged = true;
+    updateTimings(lane);
+    // whole round at once, see compileInstructions()
+    lanes.timeline[lane].clear(curFrame);
+    lanes.compiledStep[lane] = 0;
+    compileInstructions(lane);
+  }
+
+  // instructions of current round appended to the timeline from the first step not compiled yet, as long as there is room
+  // each note waits for an interval and is held for a duration, player's turn after a last interval
+  // each deadline counts from the previous one to avoid any drift, compiled with the timings and beat grid known at the beginning of the round
+  void compileInstructions(int lane) {
+    Timeline &timeline = lanes.timeline[lane];
+    int &step = lanes.compiledStep[lane];
+    const int round = lanes.round[lane];
+    uint64_t deadline = timeline.getLast();
+    while (step < round && timeline.getFree() >= 2) {
+      const uint8_t note = noteAt(lane, step);
+      deadline = onBeat(deadline + lanes.noteInterval[lane]);
+      timeline.push(deadline, TL_INSTRUCTION_ON, note);
+      deadline += lanes.noteDuration[lane];
+      timeline.push(deadline, TL_INSTRUCTION_OFF, note);
+      step++;
+    }
+    // past round once player's turn is compiled
+    if (step == round && timeline.push(deadline + lanes.noteInterval[lane], TL_PLAYER_TURN)) {
+      step++;
+    }
+  }
+
+  // draw another note to the sequence, or take the next one of the melody -- the game is over once it is played entirely
+  void addNote(int lane) {
+    const int round = lanes.round[lane];
+    if ((!endless && round >= MAX_ROUND) || round >= MAX_ENDLESS_ROUND || (melodyLine != nullptr && round >= melodyLine->nbNotes)) {
+      stop(lane);
+    }
+    // might be already drawn upon new game, beyond MAX_ROUND nothing is stored
+    else if (round >= 0 && round < MAX_ROUND && lanes.sequence[lane][round] == NO_NOTE) {
+      // candidates depend on root, number of notes and scale, cached in-between games -- as well as transitions from previous note
+      lanes.sequence[lane][round] = melodyLine != nullptr ? melodyLine->notes[round] : layout.drawNext(round > 0 ? lanes.sequence[lane][round - 1] : -1, lanes.ran[lane]);
+    }
+  }
+
+  // note of the sequence at this step, regenerated from the key of the game beyond MAX_ROUND
+  uint8_t noteAt(int lane, int step) {
+    if (step < MAX_ROUND) {
+      return lanes.sequence[lane][step];
+    }
+    if (melodyLine != nullptr) {
+      return melodyLine->notes[step < melodyLine->nbNotes ? step : melodyLine->nbNotes - 1];
+    }
+    if (!layout.isChained()) {
+      return layout.drawAt(lanes.gameKey[lane], step);
+    }
+    // each note follows the previous one: chained from the last one computed, steps are visited in order by instructions and player
+    int &tailStep = lanes.tailStep[lane];
+    uint8_t &tailNote = lanes.tailNote[lane];
+    if (tailStep < MAX_ROUND - 1 || tailStep > step) {
+      tailStep = MAX_ROUND - 1;
+      tailNote = lanes.sequence[lane][MAX_ROUND - 1];
+    }
+    while (tailStep < step) {
+      tailStep++;
+      tailNote = layout.drawNextAt(lanes.gameKey[lane], tailStep, tailNote);
+    }
+    return tailNote;
+  }
+
+  // options of the generator, from parameters
+  GeneratorSettings generatorSettings() const {
+    GeneratorSettings settings;
+    settings.type = generator;
+    settings.maxLeap = maxLeap;
+    settings.noRepeat = noRepeat;
+    settings.stepwise = stepwise;
+    settings.tonality = tonality;
+    return settings;
+  }
+
+  // latest melody loaded and line to learn, only in-between games since the game reads it
+  void syncMelody() {
+    const Melody *loaded = melodies.fetch();
+    if (loaded != nullptr) {
+      melody = loaded;
+      if (capture != nullptr) {
+        capture->state(curFrame, CAP_STATE_MELODY, loaded->path);
       }
     }
+    const int track = melodyTrack < 0 ? 0 : melodyTrack > MELODY_MAX_TRACKS ? MELODY_MAX_TRACKS : melodyTrack;
+    if (melodyMode && melody != nullptr && melody->lines[track].nbNotes > 0) {
+      melodyLine = &melody->lines[track];
+      melodyLength = melodyLine->nbNotes;
+    }
+    else {
+      melodyLine = nullptr;
+      melodyLength = 0;
+    }
   }
 
-  // playing next note in the sequence
+  // playing next note of the instructions
   // frame: frame of the event in the buffer
-  void nextNote(uint32_t frame=0) {
-    // reached end of sequence, user's turn
-    if((int) stepN >= round) {
-      status = PLAYING_WAIT;
-      // reset counter for user
-      stepN = 0;
+  void nextNote(int lane, uint8_t note, uint32_t frame=0) {
+    int &stepN = lanes.stepN[lane];
+    lanes.curNote[lane] = note;
+    // channel of the player and full velocity by default, first channel with a single player
+    lanes.curChannel[lane] = lane;
+    playNote(note, 127, lane, frame);
+    exportNote(EXPORT_INSTRUCTIONS, 0x90 | lane, note, 127, frame);
+    // reference for rhythm, beyond MAX_ROUND the last interval is reused
+    if (stepN < MAX_ROUND) {
+      lanes.instructionOnsets[lane][stepN] = secondsAt(blockFrame + frame);
     }
-    else if (stepN < MAX_ROUND) {
-      curNote = sequence[stepN];
-      if (curNote >= 0) {
-        // last used channel and full velocity by default
-        curChannel = 0;
-        sendNoteOn(curNote, 127, curChannel, frame);
-        stepN++;
-      }
+    stepN++;
+  }
+
+  // note of the game for the MIDI export, if enabled. status with channel
+  // frame: frame of the event in the buffer
+  void exportNote(uint8_t track, uint8_t status, uint8_t note, uint8_t velocity, uint32_t frame) {
+    if (midiExport != nullptr) {
+      midiExport->note(secondsAt(blockFrame + frame), track, status, note, velocity);
     }
   }
 
-  // deal with feedback incorrect, check if lost
-  // flag: true to start the feedback, otherwise let it run
-  // note: handles its own state, send notes to last used channel
-  void feedbackIncorrect(FeedbackStatus flag, uint32_t frame=0) {
-    switch (flag) {
-    // start incorrect feedback
-    case FB_STATUS_START:
-      status = FEEDBACK_INCORRECT;
-      // init counter
-      lastTime = curTime;
-      // bad chord for bad feedback
-      sendNoteOn(45, 127, curChannel, frame);
-      sendNoteOn(46, 127, curChannel, frame);
-      sendNoteOn(47, 127, curChannel, frame);
-      break;
-    // let it run
-    case FB_STATUS_RUN:
-      // time to end the notes
-      if (curTime - lastTime >= NOTE_INTERVAL) {
-        // turn off ourselves
-        feedbackIncorrect(FB_STATUS_STOP, frame);
-        // this was the last straw
-        if (nbMiss > maxMiss) {
-          feedbackLost(FB_STATUS_START, frame);
-        }
-        // again player's turn
-        else {
-          status = PLAYING_WAIT;
-        }
-      }
-      break;
-      // emergency stop
-    case FB_STATUS_STOP:
-      // check if we are indeed in this feedback before turning off
-      sendNoteOff(45, curChannel, frame);
-      sendNoteOff(46, curChannel, frame);
-      sendNoteOff(47, curChannel, frame);
-      break;
-    default:
-      break;;
+  // continuous time of an absolute frame, in seconds, whatever the sample rate changes in-between
+  double secondsAt(uint64_t frame) const {
+    return clockSeconds + (double) (frame - clockFrame) / sampleRate;
+  }
+
+  // time between the onset of this step and the previous one during instructions
+  double instructionInterval(int lane, int step) const {
+    if (step >= MAX_ROUND) {
+      step = MAX_ROUND - 1;
+    }
+    return lanes.instructionOnsets[lane][step] - lanes.instructionOnsets[lane][step - 1];
+  }
+
+  // compare timing of a correct note with instructions, using previous one as reference
+  // return false if it is too far off, with tolerance enabled
+  bool scoreOnset(int lane, uint32_t frame) {
+    const double onset = secondsAt(blockFrame + frame);
+    const double previous = lanes.lastOnset[lane];
+    const int stepN = lanes.stepN[lane];
+    lanes.lastOnset[lane] = onset;
+    // first step, or rhythm was broken by a miss
+    if (stepN < 1 || previous < 0) {
+      return true;
+    }
+    const double error = (onset - previous) - instructionInterval(lane, stepN);
+    const int nbTimings = ++lanes.nbTimings[lane];
+    lanes.sumTimings[lane] += error;
+    lanes.sumSqTimings[lane] += error * error;
+    const double mean = lanes.sumTimings[lane] / nbTimings;
+    const double variance = lanes.sumSqTimings[lane] / nbTimings - mean * mean;
+    lanes.timingMean[lane] = lround(mean * 1000);
+    lanes.timingJitter[lane] = lround(sqrt(variance > 0 ? variance : 0) * 1000);
+    return tolerance <= 0 || fabs(error) * 1000 <= tolerance;
+  }
+
+  // start feedback once user hit an incorrect note, check if lost when it ends
+  // note: send notes to last used channel
+  void feedbackIncorrect(int lane, uint32_t frame=0) {
+    // bad chord for bad feedback
+    static const int incorrectNbNotes = 3;
+    static const int incorrectNotes[incorrectNbNotes] = {45, 46, 47};
+
+    Timeline &timeline = lanes.timeline[lane];
+    lanes.status[lane] = FEEDBACK_INCORRECT;
+    const uint64_t deadline = curFrame + lanes.noteInterval[lane];
+    timeline.clear();
+    for (int i = 0; i < incorrectNbNotes; i++) {
+      playNote(incorrectNotes[i], 127, lanes.curChannel[lane], frame);
+      timeline.push(deadline, TL_FEEDBACK_OFF, incorrectNotes[i]);
     }
+    timeline.push(deadline, TL_INCORRECT_DONE);
   }
 
-  // deal with feedback once game is lost, terminate round once done
-  // raise: true to start the feedback, otherwise let it run
-  // note: handles its own state, send notes to last used channel
-  void feedbackLost(FeedbackStatus flag, uint32_t frame=0) {
+  // start feedback once game is lost, terminate round once done
+  // note: send notes to last used channel
+  void feedbackLost(int lane, uint32_t frame=0) {
     // the "medoly" we will play upon loss
     static const int lostNbNotes = 3;
     static const int lostNotes[lostNbNotes] = {60, 57, 53};
 
-    switch(flag) {
-      // start incorrect feedback
-    case FB_STATUS_START:
-      status = FEEDBACK_LOST;
-      // init counter
-      lastTime = curTime;
-      feedbackCounter = 0;
-      sendNoteOn(lostNotes[feedbackCounter], 127, curChannel, frame);
+    Timeline &timeline = lanes.timeline[lane];
+    const uint64_t noteInterval = lanes.noteInterval[lane];
+    lanes.status[lane] = FEEDBACK_LOST;
+    uint64_t deadline = curFrame;
+    timeline.clear();
+    playNote(lostNotes[0], 127, lanes.curChannel[lane], frame);
+    for (int i = 1; i < lostNbNotes; i++) {
+      deadline += noteInterval;
+      timeline.push(deadline, TL_FEEDBACK_OFF, lostNotes[i-1]);
+      timeline.push(deadline, TL_FEEDBACK_ON, lostNotes[i]);
+    }
+    deadline += noteInterval;
+    timeline.push(deadline, TL_FEEDBACK_OFF, lostNotes[lostNbNotes-1]);
+    timeline.push(deadline, TL_LOST_DONE);
+  }
+
+  // a deadline of this player is reached, apply its action
+  // frame: frame of the event in the buffer
+  void dispatch(int lane, const TimelineEntry &entry, uint32_t frame) {
+    Timeline &timeline = lanes.timeline[lane];
+    switch(entry.action) {
+    case TL_NEW_ROUND:
+      newRound(lane);
       break;
-    case FB_STATUS_RUN:
-      // time to end the notes
-      if (curTime - lastTime >= NOTE_INTERVAL) {
-        // turn off current note
-        feedbackLost(FB_STATUS_STOP, frame);
-        // next in the medoly
-        feedbackCounter++;
-        // finished for good
-        if (feedbackCounter >= lostNbNotes) {
-          stop();
-        }
-        // continue
-        else {
-          lastTime = curTime;
-          sendNoteOn(lostNotes[feedbackCounter], 127, curChannel, frame);
-        }
+    case TL_INSTRUCTION_ON:
+      nextNote(lane, entry.note, frame);
+      break;
+    case TL_INSTRUCTION_OFF:
+      abortCurrentNote(lane, frame);
+      exportNote(EXPORT_INSTRUCTIONS, 0x80 | lane, entry.note, 0, frame);
+      // endless round longer than the timeline: next chunk once half of it is consumed
+      if (lanes.compiledStep[lane] <= lanes.round[lane] && timeline.getFree() >= TIMELINE_SIZE / 2) {
+        compileInstructions(lane);
       }
       break;
-    case FB_STATUS_STOP:
-        if (feedbackCounter < lostNbNotes) {
-          sendNoteOff(lostNotes[feedbackCounter], curChannel, frame);
+    case TL_PLAYER_TURN:
+      lanes.status[lane] = PLAYING_WAIT;
+      // reset counter for user
+      lanes.stepN[lane] = 0;
+      break;
+    case TL_FEEDBACK_ON:
+      playNote(entry.note, 127, lanes.curChannel[lane], frame);
+      break;
+    case TL_FEEDBACK_OFF:
+      releaseNote(entry.note, lanes.curChannel[lane], frame);
+      break;
+    case TL_INCORRECT_DONE:
+      // this was the last straw
+      if (lanes.nbMiss[lane] > lanes.maxMiss[lane]) {
+        feedbackLost(lane, frame);
+      }
+      // again player's turn, unless a note out of rhythm was the last one
+      else {
+        lanes.status[lane] = PLAYING_WAIT;
+        if (lanes.stepN[lane] >= lanes.round[lane]) {
+          newRound(lane);
         }
+      }
+      break;
+    case TL_LOST_DONE:
+      // finished for good
+      stop(lane);
       break;
     default:
       break;
     }
+    publishEvents(frame);
+  }
+
+  // push to the UI everything that changed since last call, note last so that UI knows the status upon a new note
+  // with several players the UI follows the first one, others only through their outputs
+  // frame: frame of the event in the buffer
+  void publishEvents(uint32_t frame) {
+    if (events == nullptr) {
+      return;
+    }
+    const uint64_t eventFrame = blockFrame + frame;
+    if (lanes.status[0] != sentStatus) {
+      sentStatus = lanes.status[0];
+      pushEvent(eventFrame, EV_STATUS, sentStatus);
+    }
+    if (lanes.round[0] != sentRound) {
+      sentRound = lanes.round[0];
+      pushEvent(eventFrame, EV_ROUND, sentRound);
+    }
+    if (lanes.stepN[0] != sentStep) {
+      sentStep = lanes.stepN[0];
+      pushEvent(eventFrame, EV_STEP, sentStep);
+    }
+    if (lanes.nbMiss[0] != sentMiss) {
+      sentMiss = lanes.nbMiss[0];
+      pushEvent(eventFrame, EV_MISS, sentMiss);
+    }
+    if (lanes.curNote[0] != sentNote) {
+      sentNote = lanes.curNote[0];
+      pushEvent(eventFrame, EV_NOTE, sentNote);
+    }
+  }
+
+  // state of the games to output parameters, once per block: the first player as in single player, then players in use
+  void publishOutputs() {
+    values[kStatus] = lanes.status[0];
+    values[kRound] = lanes.round[0];
+    values[kStep] = lanes.stepN[0];
+    values[kNbMiss] = lanes.nbMiss[0];
+    values[kMaxMiss] = lanes.maxMiss[0];
+    values[kCurNote] = lanes.curNote[0];
+    values[kTimingMean] = lanes.timingMean[0];
+    values[kTimingJitter] = lanes.timingJitter[0];
+    for (int lane = 0; lane < effectiveNbLanes; lane++) {
+      values[laneParameter(lane, LANE_STATUS)] = lanes.status[lane];
+      values[laneParameter(lane, LANE_ROUND)] = lanes.round[lane];
+      values[laneParameter(lane, LANE_MISS)] = lanes.nbMiss[lane];
+    }
+  }
+
+  void pushEvent(uint64_t frame, uint8_t type, int32_t value) {
+    if (!events->queue.push({frame, type, value})) {
+      events->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // keep track of the absolute frame of the buffer, events are sent with their offset in it
+  // also apply at once all parameter changes since last block
+  void run(const float** inputs, float** outputs, uint32_t frames, const MidiEvent* midiEvents, uint32_t midiEventCount) override {
+    // built-in synth catches up with each note we send, silence if none -- nothing is rendered without audio outputs
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+    synth.beginBlock(outputs[0], frames);
+#endif
+    if (capture != nullptr) {
+      capture->block(curFrame, frames, sampleRate);
+    }
+    parameters.consume([this](uint32_t index, float value) {
+      if (capture != nullptr) {
+        capture->parameter(curFrame, index, value);
+      }
+      applyParameter(index, value);
+    });
+    // after parameters, so that a game started upon loading is replaced by the saved one
+    const Session *restored = restoredSessions.fetch();
+    if (restored != nullptr) {
+      // the melody of a saved game is loaded along
+      syncMelody();
+      restoreSession(*restored);
+      // as the host would get it back, see getState()
+      if (capture != nullptr) {
+        uint8_t blob[STATE_MAX_SIZE];
+        char text[STATE_MAX_TEXT];
+        encodeBase64(blob, writeSession(*restored, blob), text);
+        capture->state(curFrame, CAP_STATE_SESSION, text);
+      }
+    }
+    // before anything is rendered, outputs might share the buffers of inputs
+    // a note still on when disabled is released
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+    if (audioInput || detector.getSounding() >= 0 || nbPendingOffs > 0) {
+      midiEvents = mergeDetected(inputs != nullptr ? inputs[0] : nullptr, frames, midiEvents, midiEventCount);
+    }
+#endif
+    // detected notes are recorded as MIDI, a replay needs no audio
+    if (capture != nullptr) {
+      for (uint32_t i = 0; i < midiEventCount; i++) {
+        capture->midi(curFrame + midiEvents[i].frame, midiEvents[i].size, midiEvents[i].data);
+      }
+    }
+    blockFrame = curFrame;
+    blockEvents = midiEvents;
+    nbBlockEvents = midiEventCount;
+    nextEvent = 0;
+    syncTempo();
+    if (capture != nullptr && tempoSync) {
+      const TimePosition &pos = getTimePosition();
+      capture->tempo(curFrame, pos.playing && pos.bbt.valid, pos.bbt.beatsPerMinute, pos.bbt.ticksPerBeat > 0 ? pos.bbt.tick / pos.bbt.ticksPerBeat : 0);
+    }
+    ExtendedPlugin::run(inputs, outputs, frames, midiEvents, midiEventCount);
+    // what is left after our last note, skipping notes that were not for us
+    while (nextEvent < nbBlockEvents) {
+      reachNoteEvent(blockEvents[nextEvent].frame);
+    }
+    blockEvents = nullptr;
+    nbBlockEvents = 0;
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+    // mono
+    const bool sounding = synth.endBlock();
+    for (int channel = 1; channel < DISTRHO_PLUGIN_NUM_OUTPUTS; channel++) {
+      if (sounding) {
+        memcpy(outputs[channel], outputs[0], frames * sizeof(float));
+      }
+      else {
+        memset(outputs[channel], 0, frames * sizeof(float));
+      }
+    }
+#endif
+    publishOutputs();
+    if (sessionChanged) {
+      saveSession();
+    }
+  }
+
+  // notes detected in audio input merged with events from the host by frame, on the first channel, after host events of the same frame
+  // return what to process instead of the events from the host, count is updated. Host events are never lost. When there is not enough room,
+  // note off come first: the last note on are dropped, along with their note off, and note off that still do not fit are delayed to the next block.
+  const MidiEvent *mergeDetected(const float *input, uint32_t frames, const MidiEvent *midiEvents, uint32_t &midiEventCount) {
+    DetectedNote notes[2 * DETECT_MAX_NOTES];
+    uint32_t nbNotes = 0;
+    for (uint32_t i = 0; i < nbPendingOffs; i++) {
+      notes[nbNotes] = pendingOffs[i];
+      notes[nbNotes++].frame = 0;
+    }
+    nbPendingOffs = 0;
+    nbNotes += audioInput ? detector.process(input, frames, notes + nbNotes, DETECT_MAX_NOTES) : detector.release(0, notes + nbNotes);
+    if (nbNotes == 0) {
+      return midiEvents;
+    }
+    uint32_t nbOff = 0;
+    for (uint32_t i = 0; i < nbNotes; i++) {
+      nbOff += notes[i].on ? 0 : 1;
+    }
+    const uint32_t room = midiEventCount < DETECT_MAX_EVENTS ? DETECT_MAX_EVENTS - midiEventCount : 0;
+    uint32_t nbOnLeft = room > nbOff ? room - nbOff : 0;
+    // notes kept in order, note on as long as there is room left once all note off are counted
+    uint32_t nbKept = 0;
+    for (uint32_t i = 0; i < nbNotes; i++) {
+      const DetectedNote &note = notes[i];
+      if (note.on) {
+        droppedNotes[note.note] = nbOnLeft == 0;
+        if (droppedNotes[note.note]) {
+          continue;
+        }
+        nbOnLeft--;
+      }
+      else if (droppedNotes[note.note]) {
+        droppedNotes[note.note] = false;
+        continue;
+      }
+      else if (nbKept >= room) {
+        pendingOffs[nbPendingOffs++] = note;
+        continue;
+      }
+      notes[nbKept++] = note;
+    }
+    if (nbKept == 0) {
+      return midiEvents;
+    }
+    uint32_t nbEvents = 0;
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < nbKept; i++) {
+      while (next < midiEventCount && midiEvents[next].frame <= notes[i].frame) {
+        mergedEvents[nbEvents++] = midiEvents[next++];
+      }
+      MidiEvent &event = mergedEvents[nbEvents++];
+      event.frame = notes[i].frame;
+      event.size = 3;
+      event.data[0] = notes[i].on ? 0x90 : 0x80;
+      event.data[1] = notes[i].note;
+      event.data[2] = notes[i].velocity;
+      event.data[3] = 0;
+      event.dataExt = nullptr;
+    }
+    while (next < midiEventCount) {
+      mergedEvents[nbEvents++] = midiEvents[next++];
+    }
+    midiEventCount = nbEvents;
+    return mergedEvents;
+  }
+
+  // snapshot of what is worth keeping, for getState(), only when something changed (new round, miss, game over...)
+  void saveSession() {
+    Session &session = sessions.back();
+    session.seed = seed;
+    session.maxRound = maxRound;
+    session.nbLanes = effectiveNbLanes;
+    for (int lane = 0; lane < effectiveNbLanes; lane++) {
+      LaneSession &saved = session.lanes[lane];
+      saved.status = lanes.status[lane];
+      saved.round = lanes.round[lane];
+      saved.nbMiss = lanes.nbMiss[lane];
+      saved.maxMiss = lanes.maxMiss[lane];
+      saved.lastRFM = lanes.lastRFM[lane];
+      saved.gameKey = lanes.gameKey[lane];
+      saved.random = lanes.ran[lane].getState();
+      // notes are drawn in order
+      int nbNotes = 0;
+      while (nbNotes < MAX_ROUND && lanes.sequence[lane][nbNotes] != NO_NOTE) {
+        nbNotes++;
+      }
+      saved.nbNotes = nbNotes;
+      memcpy(saved.sequence, lanes.sequence[lane], nbNotes);
+    }
+    sessions.publish();
+    sessionChanged = false;
+  }
+
+  // back to a saved session, from the audio thread. Games in progress resume with the instructions of their current round.
+  void restoreSession(const Session &session) {
+    seed = session.seed;
+    maxRound = session.maxRound;
+    updateNbLanes(session.nbLanes);
+    // whatever was sounding belongs to the previous session
+    releasing = releasing || activeNotes.any();
+    for (int lane = 0; lane < effectiveNbLanes; lane++) {
+      const LaneSession &saved = session.lanes[lane];
+      reset(lane);
+      lanes.ran[lane].setState(saved.random);
+      lanes.gameKey[lane] = saved.gameKey;
+      memcpy(lanes.sequence[lane], saved.sequence, saved.nbNotes);
+      lanes.nbMiss[lane] = saved.nbMiss;
+      lanes.maxMiss[lane] = saved.maxMiss;
+      lanes.lastRFM[lane] = saved.lastRFM;
+      lanes.timeline[lane].clear();
+      if (isRunning(saved.status)) {
+        // as upon a new game, pause then round starts over -- notes are already drawn
+        lanes.status[lane] = STARTING;
+        lanes.round[lane] = saved.round > 0 ? saved.round - 1 : 0;
+        updateTimings(lane);
+        lanes.timeline[lane].push(curFrame + lanes.noteInterval[lane], TL_NEW_ROUND);
+      }
+      else {
+        lanes.status[lane] = saved.status;
+        lanes.round[lane] = saved.round;
+        updateTimings(lane);
+      }
+    }
+    sessionChanged = true;
   }
 
   void process(uint32_t nbSamples, uint32_t frame) override {
     // in-between games, sync state
     // Note: upon change on root or nbNotes we will kill any pending notes, to avoid stuck keys upon shifting
-    if (!isRunning(status)) {
-      if (effectiveRoot != root) {
-        abortCurrentNote(frame);
-        effectiveRoot = root;
+    if (!anyRunning()) {
+      // channels are mapped differently
+      if (effectiveNbLanes != clampedNbLanes()) {
+        releaseAllNotes(frame);
+        updateNbLanes(clampedNbLanes());
+      }
+      // a melody imposes its range and scale
+      syncMelody();
+      const int targetRoot = melodyLine != nullptr ? melodyLine->low : root;
+      const int targetNbNotes = melodyLine != nullptr ? melodyLine->high - melodyLine->low + 1 : nbNotes;
+      if (effectiveRoot != targetRoot) {
+        releaseAllNotes(frame);
+        effectiveRoot = targetRoot;
       }
       // limit number of notes depending on root position
       int maxNotes = params[kNbNotes].max - effectiveRoot;
-      if (nbNotes > maxNotes && effectiveNbNotes != maxNotes) {
-        abortCurrentNote(frame);
+      if (targetNbNotes > maxNotes && effectiveNbNotes != maxNotes) {
+        releaseAllNotes(frame);
         effectiveNbNotes = maxNotes;
       }
-      else if (nbNotes <= maxNotes && effectiveNbNotes != nbNotes) {
-        abortCurrentNote(frame);
-        effectiveNbNotes = nbNotes;
+      else if (targetNbNotes <= maxNotes && effectiveNbNotes != targetNbNotes) {
+        releaseAllNotes(frame);
+        effectiveNbNotes = targetNbNotes;
       }
       // sync scale now
       for (int i = 0; i < 12; i++) {
-        effectiveScale[i] = scale[i];
-      }
-    }
-
-    // the game might have ended from user call, check here if we need to abort a note
-    if (stopping) {
-      // check for emergency abort of feedback
-      switch(status) {
-      case FEEDBACK_INCORRECT:
-        feedbackIncorrect(FB_STATUS_STOP, frame);
-        break;
-      case FEEDBACK_LOST:
-        feedbackLost(FB_STATUS_STOP, frame);
-        break;
-      default:
-        break;
-      }
-      // abort current note, if any
-      abortCurrentNote(frame);
-      stopping = false;
-      status = GAMEOVER;
-    }
-
-    // update time
-    for (uint32_t i = 0; i < nbSamples; i++) {
-      curTime +=  1./ getSampleRate();
-      double elapsedTime = curTime - lastTime;
-
-      switch(status) {
-      // pause before real start
-      case STARTING:
-        if (elapsedTime >= NOTE_INTERVAL) {
-          newRound();
-        }
-        break;
-      // displaying example
-      case INSTRUCTIONS:
-        // displaying note, wait to turn it off
-        if (curNote >= 0) {
-          if (elapsedTime >= NOTE_DURATION) {
-            lastTime = curTime;
-            abortCurrentNote(frame + i);
-          }
-        }
-        // test if we should start new note
-        else {
-          if (elapsedTime >= NOTE_INTERVAL) {
-            lastTime = curTime;
-            nextNote(frame + i);
-          }
-        }
-          break;
-      case FEEDBACK_INCORRECT:
-        // currently giving feedback, let it run
-        feedbackIncorrect(FB_STATUS_RUN, frame + i);
-        break;
-      case FEEDBACK_LOST:
-        feedbackLost(FB_STATUS_RUN, frame + i);
-        break;
-      default:
-        break;
+        effectiveScale[i] = melodyLine != nullptr ? melodyLine->scale[i] : scale[i];
+      }
+      // tables are only rebuilt upon change
+      layout.update(effectiveRoot, effectiveNbNotes, effectiveScale);
+      layout.setGenerator(generatorSettings());
+    }
+    // this option is applied right away, even during a game
+    layout.setShallNotPass(shallNotPass);
+
+    // plugin was deactivated since last call, downstream might still hold our notes
+    if (releasing) {
+      releaseAllNotes(frame);
+      releasing = false;
+    }
+
+    // a game might have ended from user call, check here if we need to abort a note
+    for (int lane = 0; lane < effectiveNbLanes; lane++) {
+      if (lanes.stopping[lane]) {
+        // emergency abort of feedback and current note, if any
+        lanes.timeline[lane].clear();
+        releaseLane(lane, frame);
+        lanes.stopping[lane] = false;
+        lanes.status[lane] = GAMEOVER;
+        sessionChanged = true;
       }
     }
+    if (exporting && !anyRunning()) {
+      midiExport->gameEnd(secondsAt(curFrame));
+      exporting = false;
+    }
+    // changes made outside of process or upon sync
+    publishEvents(frame);
 
+    // only visit deadlines due in this buffer, actions might compile new ones
+    // all players in one pass, in chronological order so that MIDI events stay sorted
+    const uint64_t startFrame = curFrame;
+    const uint64_t endFrame = startFrame + nbSamples;
+    TimelineEntry entry;
+    int lane;
+    while ((lane = nextDue(endFrame)) >= 0) {
+      lanes.timeline[lane].pop(endFrame, entry);
+      // move to the frame of the entry within the buffer, an entry already late (frame before curFrame) is dealt with right away
+      if (entry.frame > curFrame) {
+        curFrame = entry.frame;
+      }
+      dispatch(lane, entry, frame + (curFrame - startFrame));
+    }
+    curFrame = endFrame;
   };
 
-  // abort current play: raise flag, update max round
+  // player with the earliest deadline before end (excluded), first one upon ties, -1 if none
+  int nextDue(uint64_t end) const {
+    int due = -1;
+    for (int lane = 0; lane < effectiveNbLanes; lane++) {
+      uint64_t frame;
+      if (lanes.timeline[lane].peek(frame) && frame < end) {
+        end = frame;
+        due = lane;
+      }
+    }
+    return due;
+  }
+
+  // convert timings to frames once, and keep pending deadlines at the same distance in seconds
+  void sampleRateChanged(double newSampleRate) override {
+    if (newSampleRate <= 0) {
+      return;
+    }
+    // schedule is not compiled again during a game, parameters might have changed since it started
+    const bool rescaling = sampleRate > 0 && anyRunning();
+    if (sampleRate > 0 && newSampleRate != sampleRate) {
+      const double ratio = newSampleRate / sampleRate;
+      for (int lane = 0; lane < MAX_LANES; lane++) {
+        lanes.timeline[lane].rescale(curFrame, ratio);
+      }
+      for (int r = 0; rescaling && r < MAX_ROUND; r++) {
+        schedule[r].interval = schedule[r].interval * ratio + 0.5;
+        schedule[r].duration = schedule[r].duration * ratio + 0.5;
+      }
+    }
+    // onsets are kept in seconds, clock goes on at the new rate from here
+    if (sampleRate > 0) {
+      clockSeconds = secondsAt(curFrame);
+      clockFrame = curFrame;
+    }
+    sampleRate = newSampleRate;
+    synth.setSampleRate(sampleRate);
+    detector.setSampleRate(sampleRate);
+    if (!rescaling) {
+      compileSchedule();
+    }
+    updateAllTimings();
+    updateDebounce();
+  }
+
+  // follow the transport of the host, at the beginning of each block
+  // note: DPF only gives the position at the start of the block, a tempo change within the block is taken into account from the next one
+  void syncTempo() {
+    const TimePosition &pos = getTimePosition();
+    const bool wasSynced = synced;
+    synced = tempoSync && pos.playing && pos.bbt.valid && pos.bbt.beatsPerMinute > 0 && pos.bbt.ticksPerBeat > 0;
+    if (synced) {
+      // beat grid, from the position within current beat
+      framesPerBeat = 60 * sampleRate / pos.bbt.beatsPerMinute;
+      beatOrigin = blockFrame - pos.bbt.tick / pos.bbt.ticksPerBeat * framesPerBeat;
+    }
+    // back to free-running timings once transport stops
+    if (synced || wasSynced) {
+      updateAllTimings();
+    }
+  }
+
+  // speed of instructions at this round (0 for first one) relative to first one, from curve and speed-up at MAX_ROUND
+  double curveSpeed(int r) const {
+    const double speedUp = intervalSpeedUp / 100.0;
+    switch (intervalCurve) {
+    case CURVE_LINEAR:
+      return 1 + speedUp * r / (MAX_ROUND - 1);
+    case CURVE_EXPONENTIAL:
+      return pow(1 + speedUp, (double) r / (MAX_ROUND - 1));
+    case CURVE_STEPPED:
+      return 1 + speedUp * (r / CURVE_STEP_ROUNDS) / (MAX_ROUND / CURVE_STEP_ROUNDS - 1);
+    default:
+      return 1;
+    }
+  }
+
+  // timings in frames for every round, evaluated once per game (or upon changes in-between)
+  // note: durations are scaled by the same curve, ratio between interval and duration is kept
+  void compileSchedule() {
+    for (int r = 0; r < MAX_ROUND; r++) {
+      const double speed = curveSpeed(r);
+      schedule[r].interval = intervalMs * sampleRate / 1000 / speed + 0.5;
+      schedule[r].duration = durationMs * sampleRate / 1000 / speed + 0.5;
+    }
+  }
+
+  // timings of current round of this player, from the schedule or derived from host tempo
+  // rounds beyond MAX_ROUND stick to the last one
+  void updateTimings(int lane) {
+    const int round = lanes.round[lane];
+    const RoundTiming &timing = schedule[round < 1 ? 0 : round > MAX_ROUND ? MAX_ROUND - 1 : round - 1];
+    uint64_t &noteInterval = lanes.noteInterval[lane];
+    uint64_t &noteDuration = lanes.noteDuration[lane];
+    if (synced) {
+      // each instruction takes a beat, same ratio between interval and duration
+      const double ratio = (double) timing.duration / (timing.interval + timing.duration);
+      noteDuration = framesPerBeat * ratio + 0.5;
+      noteInterval = framesPerBeat * (1 - ratio) + 0.5;
+    }
+    else {
+      noteInterval = timing.interval;
+      noteDuration = timing.duration;
+    }
+    // as heard by the first player
+    if (lane == 0) {
+      tempo = noteInterval + noteDuration > 0 ? 60 * sampleRate / (noteInterval + noteDuration) + 0.5 : 0;
+    }
+  }
+
+  void updateAllTimings() {
+    for (int lane = 0; lane < MAX_LANES; lane++) {
+      updateTimings(lane);
+    }
+  }
+
+  // first beat of the host at or after this frame, the frame itself when not synced
+  uint64_t onBeat(uint64_t frame) const {
+    if (!synced) {
+      return frame;
+    }
+    const double beats = ceil((frame - beatOrigin - SYNC_TOLERANCE) / framesPerBeat);
+    const double beatFrame = beatOrigin + beats * framesPerBeat + 0.5;
+    return beatFrame > 0 ? beatFrame : 0;
+  }
+
+  // MIDI can only be sent while processing, notes will be released upon next run
+  void deactivate() override {
+    releasing = activeNotes.any();
+  }
+
+  // abort current play of this player: raise flag, update max round
   // note: do not discard current note here since we might be called outside of process()
-  void stop() {
-    stopping = true;
+  void stop(int lane) {
+    lanes.stopping[lane] = true;
     // level up!
+    const int round = lanes.round[lane];
     if (round > 0 && round - 1 > maxRound) {
       maxRound = round - 1;
     }
   }
 
-  // reset inner state upon new game
+  // reset inner state of this player upon new game
   // NOTE: *not* resetting curNote as is can be needed to abort later on, reset being called outside of run (
-  void reset() {
+  void reset(int lane) {
     // init array
     for (int i = 0; i < MAX_ROUND; i++) {
-      sequence[i] = -1;
+      lanes.sequence[lane][i] = NO_NOTE;
     }
-    round = 0;
-    stepN = 0;
-    nbMiss = 0;
-    maxMiss = 0;
-    lastRFM = 0;
-    stopping = false;
+    lanes.round[lane] = 0;
+    lanes.stepN[lane] = 0;
+    lanes.nbMiss[lane] = 0;
+    lanes.maxMiss[lane] = 0;
+    lanes.lastRFM[lane] = 0;
+    lanes.timingMean[lane] = 0;
+    lanes.timingJitter[lane] = 0;
+    lanes.stopping[lane] = false;
+    lanes.tailStep[lane] = -1;
+    lanes.compiledStep[lane] = 0;
   }
 
 private:
-  // parameters
-  bool start = false;
-  int status = params[kStatus].def;
-  int root = params[kRoot].def;
-  int nbNotes = params[kNbNotes].def;
-  int effectiveRoot =  params[kEffectiveRoot].def;
-  int effectiveNbNotes =  params[kEffectiveNbNotes].def;
-  int curNote = params[kCurNote].def;
-  bool scale[12] {true};
-  bool effectiveScale[12] {true};
+  // parameters, applied inputs and outputs, indexed as Parameters
+  int values[kParameterCount];
+  // ...and by name
+  int &start = values[kStart];
+  int &root = values[kRoot];
+  int &nbNotes = values[kNbNotes];
+  int &effectiveRoot = values[kEffectiveRoot];
+  int &effectiveNbNotes = values[kEffectiveNbNotes];
+  int *const scale = values + kScaleC;
+  int *const effectiveScale = values + kEffectiveScaleC;
   // if notes outside scale should go through at all
-  bool shallNotPass = params[kShallNotPass].def;
-  // how many notes are missed in this round
-  int nbMiss = 0;
-  // max miss before game over
-  int maxMiss = 0;
+  int &shallNotPass = values[kShallNotPass];
   // increase number of possible miss every xx round
-  int roundsForMiss = 1;
-  // max round completed
-  int maxRound = 0;
-  // associated channel, to abort note
-  int curChannel = 0;
-  // current round number
-  int round = params[kRound].def;
-  // for computing time based on frame count
-  double curTime = 0;
-  double lastTime = 0;
-  // sequence of notes for this round
-  int sequence[MAX_ROUND];
-  // where in the sequence the instruction or the player is at
-  uint stepN = 0;
-  // our number generator
-  Rando ran;
-  // last time a miss was granted
-  int lastRFM = 0;
-  // user requested abort or conditions reached for end
-  bool stopping = false;
-  // generic counter that can be used by feedback
-  unsigned int feedbackCounter = 0;
+  int &roundsForMiss = values[kRoundsForMiss];
+  // max round completed, by any player
+  int &maxRound = values[kMaxRound];
+  // seed for each new game, 0 to keep on with current sequence of numbers
+  int &gameSeed = values[kSeed];
+  // draw all the sequence upon new game
+  int &pregenerate = values[kPregenerate];
+  // do not stop at MAX_ROUND
+  int &endless = values[kEndless];
+  // debounce window in ms, and how many notes it filtered
+  int &debounce = values[kDebounce];
+  int &nbFiltered = values[kFiltered];
+  // option, and if it is effective for current block, i.e. host transport rolling
+  int &tempoSync = values[kTempoSync];
+  bool synced = false;
+  // timings of instructions in ms, and how they evolve
+  int &intervalMs = values[kInterval];
+  int &durationMs = values[kDuration];
+  int &intervalCurve = values[kCurve];
+  int &intervalSpeedUp = values[kSpeedUp];
+  // resulting instructions per minute
+  int &tempo = values[kTempo];
+  // rhythm, in ms
+  int &tolerance = values[kTolerance];
+  // which messages other than notes go through
+  int &passThrough = values[kPassThrough];
+  // number of players asked, and for current game
+  int &nbLanes = values[kLanes];
+  int effectiveNbLanes = 1;
+  // learn a melody instead of random notes, which line of the file, and length of the one in use
+  int &melodyMode = values[kMelody];
+  int &melodyTrack = values[kMelodyTrack];
+  int &melodyLength = values[kMelodyLength];
+  // how notes are drawn, applied in-between games
+  int &generator = values[kGenerator];
+  int &maxLeap = values[kMaxLeap];
+  int &noRepeat = values[kNoRepeat];
+  int &stepwise = values[kStepwise];
+  int &tonality = values[kTonality];
+  // only fed when enabled, always rendered so that it fades out once disabled
+  int &builtInSynth = values[kSynth];
+  int &synthVolume = values[kSynthVolume];
+  Synth synth;
+  // pitch tracking of audio input, with its settings, and the events of the block it is merged into
+  int &audioInput = values[kAudioInput];
+  int &audioHop = values[kAudioHop];
+  int &audioGate = values[kAudioGate];
+  AudioNoteDetector detector;
+  MidiEvent mergedEvents[DETECT_MAX_EVENTS];
+  // when a block is full: note off that did not fit, sent first in the next one -- no note on passes while some are waiting, at most one per note
+  // and notes whose note on was dropped, until their note off
+  DetectedNote pendingOffs[DETECT_MAX_NOTES];
+  uint32_t nbPendingOffs = 0;
+  bool droppedNotes[128] = {};
+  // position in time, in frames, for the game logic
+  uint64_t curFrame = 0;
+  // position of the current buffer
+  uint64_t blockFrame = 0;
+  // incoming events of the current buffer, and next one to be forwarded or handled
+  const MidiEvent *blockEvents = nullptr;
+  uint32_t nbBlockEvents = 0;
+  uint32_t nextEvent = 0;
+  // sample rate used for timings below
+  double sampleRate = 0;
+  // frames between notes of the instructions (and before first one), and how long each note is held, for each round
+  struct RoundTiming {
+    uint64_t interval;
+    uint64_t duration;
+  };
+  RoundTiming schedule[MAX_ROUND];
+  // beat grid of the host when synced: length of a beat and (absolute) frame of one of them, both fractional
+  double framesPerBeat = 0;
+  double beatOrigin = 0;
+  // sequence of notes for a round, NO_NOTE if not drawn yet
+  static const uint8_t NO_NOTE = 0xFF;
+  // debounce, last note on for each input note
+  static const uint64_t NEVER = UINT64_MAX;
+  // state of the game of each player, indexed by lane, i.e. by input and output channel
+  // one array per field so that a pass over all players only touches what it needs
+  struct Lanes {
+    int status[MAX_LANES];
+    // current round number
+    int round[MAX_LANES];
+    // where in the sequence the instruction or the player is at
+    int stepN[MAX_LANES];
+    // how many notes are missed in this round
+    int nbMiss[MAX_LANES];
+    // max miss before game over
+    int maxMiss[MAX_LANES];
+    // last time a miss was granted
+    int lastRFM[MAX_LANES];
+    // note sounding and associated channel, to abort note
+    int curNote[MAX_LANES];
+    int curChannel[MAX_LANES];
+    // user requested abort or conditions reached for end
+    bool stopping[MAX_LANES];
+    // timings of current round, or their equivalent in beats when synced
+    uint64_t noteInterval[MAX_LANES];
+    uint64_t noteDuration[MAX_LANES];
+    // deadlines of current phase
+    Timeline timeline[MAX_LANES];
+    // next step of the instructions to be compiled, past round once complete
+    int compiledStep[MAX_LANES];
+    // number generator of each player
+    Rando ran[MAX_LANES];
+    uint8_t sequence[MAX_LANES][MAX_ROUND];
+    // notes beyond MAX_ROUND only depend on it
+    uint64_t gameKey[MAX_LANES];
+    // melodic notes beyond MAX_ROUND, last one computed and its step (< MAX_ROUND if none)
+    int tailStep[MAX_LANES];
+    uint8_t tailNote[MAX_LANES];
+    // onsets of instructions for this round, and of last correct note from the player (< 0 if none to compare with)
+    double instructionOnsets[MAX_LANES][MAX_ROUND];
+    double lastOnset[MAX_LANES];
+    // timing errors of the player in this round, in seconds, and summary in ms
+    int nbTimings[MAX_LANES];
+    double sumTimings[MAX_LANES];
+    double sumSqTimings[MAX_LANES];
+    int timingMean[MAX_LANES];
+    int timingJitter[MAX_LANES];
+    uint64_t lastNoteOn[MAX_LANES][128];
+  };
+  Lanes lanes;
+  // clock in seconds: time at a reference frame, moved upon sample rate change
+  uint64_t clockFrame = 0;
+  double clockSeconds = 0;
+  // debounce window in frames
+  uint64_t debounceFrames = 0;
+  // changes from host and UI waiting for next block
+  ParameterQueue parameters;
+  // seed of our number generators
+  uint32_t seed = 0;
+  // notes in use, synced with effective root, number of notes and scale
+  NoteLayout layout;
+  // every note we sent and did not release yet
+  ActiveNotes activeNotes;
+  // release all notes at next run
+  bool releasing = false;
+  // events for UI, nullptr if none were available, id published in values
+  GameEventStream *events = nullptr;
+  uint32_t eventsId = 0;
+  // last values pushed as events
+  int sentStatus = params[kStatus].def;
+  int sentRound = params[kRound].def;
+  int sentStep = params[kStep].def;
+  int sentMiss = params[kNbMiss].def;
+  int sentNote = params[kCurNote].def;
+  // inputs recorded for replay, nullptr if disabled
+  CaptureWriter *capture = nullptr;
+  // games written to MIDI files, nullptr if disabled, and if a game is being written
+  MidiExportWriter *midiExport = nullptr;
+  bool exporting = false;
+  // session for the host: snapshots from the audio thread, and saved sessions to restore
+  mutable TripleBuffer<Session> sessions;
+  TripleBuffer<Session> restoredSessions;
+  // something to save since last snapshot
+  bool sessionChanged = true;
+  // melody: file and scratch memory of the parser, on the host side
+  String melodyPath;
+  std::vector<uint64_t> melodyScratch;
+  // parsed lines for the audio thread, last one fetched (nullptr if none yet) and line in use, nullptr if not learning a melody
+  TripleBuffer<Melody> melodies;
+  const Melody *melody = nullptr;
+  const MelodyLine *melodyLine = nullptr;
 
   DISTRHO_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SimonPiano);
 };
@@ -6,6 +6,8 @@
 
 #include "RayUI.hpp"
 #include "SimonUtils.h"
+#include "SimonEvents.h"
+#include <string.h>
 // for requestMIDI for web
 #if defined(DISTRHO_OS_WASM)
 #include "DistrhoStandaloneUtils.hpp"
@@ -65,6 +67,11 @@ public:
 
   SimonPianoUI() : RayUI(DISTRHO_UI_DEFAULT_WIDTH, DISTRHO_UI_DEFAULT_HEIGHT, UI_REFRESH_RATE, TEXTURE_FILTER_POINT)
     {
+      // until DSP tells otherwise
+      for (uint32_t i = 0; i < kParameterCount; i++) {
+	values[i] = params[i].def;
+      }
+
       String resourcesLocation = getResourcesLocation();
       d_stdout("resources location: %s", resourcesLocation.buffer());
 
@@ -126,59 +133,50 @@ protected:
       This is called by the host to inform the UI about parameter changes.
     */
     void parameterChanged(uint32_t index, float value) override {
+      if (index >= kParameterCount) {
+	return;
+      }
+      values[index] = value;
+
       switch (index) {
-      case kEffectiveRoot:
-	root = value;
-	break;
-      // only taking into account what is currently used in the DSP for UI
-      case kEffectiveNbNotes:
-	nbNotes = value;
-	break;
+      // when we got events from DSP, only keep values to resync if necessary
       case kStatus:
-	status = value;
+	if (events == nullptr) {
+	  status = value;
+	}
 	break;
       case kCurNote:
-	curNote = value;
+	if (events == nullptr) {
+	  setCurNote(value);
+	}
 	break;
       case kRound:
-	round = value;
+	if (events == nullptr) {
+	  round = value;
+	}
 	break;
       case kStep:
-	step = value;
-	break;
-      case kEffectiveScaleC:
-      case kEffectiveScaleCs:
-      case kEffectiveScaleD:
-      case kEffectiveScaleDs:
-      case kEffectiveScaleE:
-      case kEffectiveScaleF:
-      case kEffectiveScaleFs:
-      case kEffectiveScaleG:
-      case kEffectiveScaleGs:
-      case kEffectiveScaleA:
-      case kEffectiveScaleAs:
-      case kEffectiveScaleB:
-	{
-	  int numScale = index - kEffectiveScaleC;
-	  if (numScale >= 0 && numScale < 12) {
-	    scale[numScale] = value;
-	  }
+	if (events == nullptr) {
+	  step = value;
 	}
 	break;
-      case kShallNotPass:
-	shallNotPass = value;
-	break;
-      case kRoundsForMiss:
-	roundsForMiss = value;
-	break;
       case kNbMiss:
-	nbMiss = value;
-	break;
-      case kMaxMiss:
-	maxMiss = value;
+	if (events == nullptr) {
+	  nbMiss = value;
+	}
 	break;
-      case kMaxRound:
-	maxRound = value;
+      case kEventStream:
+	// only found if DSP lives in the same binary, otherwise stick to parameters
+	if ((uint32_t)value != eventsId) {
+	  eventsId = value;
+	  events = GameEventStreams::find(eventsId);
+	  if (events != nullptr) {
+	    // discard history, start from current state
+	    events->queue.clear();
+	    events->dropped.store(0);
+	  }
+	  resync();
+	}
 	break;
 
       default:
@@ -186,12 +184,40 @@ protected:
       }
     }
 
+   /**
+      A state has changed on the *plugin side*.
+      Only the melody is of interest, its file name is shown.
+    */
+    void stateChanged(const char *key, const char *value) override {
+      if (strcmp(key, MELODY_KEY) != 0 || value == nullptr) {
+	return;
+      }
+      const char *name = value;
+      for (const char *c = value; *c != '\0'; c++) {
+	if (*c == '/' || *c == '\\') {
+	  name = c + 1;
+	}
+      }
+      snprintf(melodyName, sizeof(melodyName), "%s", name);
+    }
+
     // ----------------------------------------------------------------------------------------------------------------
     // Widget Callbacks
   void onMainDisplay() override
   {
     ClearBackground(BLUE);
 
+    // catch-up with every change since last frame
+    drainEvents();
+    // display notes even if they were released since last frame
+    keyNote = curNote;
+    keyStatus = status;
+    if (curNote < 0 && flashNote >= 0) {
+      keyNote = flashNote;
+      keyStatus = flashStatus;
+    }
+    flashNote = -1;
+
     // render piano to texture -- on main display rather than canvas because cannot nest texture rendering
     BeginTextureMode(texturePiano);
     // note: since rendered to another canvas afterward no need to flip
@@ -202,7 +228,7 @@ protected:
     if (animsCount > 0) {
       bool  newAnim = false;
       // we are playing a new note, anim key press
-      if (animNote != curNote && curNote >= 0) {
+      if (animNoteOnCount != noteOnCount) {
 	animIndex = 0;
 	newAnim = true;
       }
@@ -246,7 +272,7 @@ protected:
 	}
       }
 
-      animNote = curNote;
+      animNoteOnCount = noteOnCount;
       animStatus = status;
       newAnim = false;
     }
@@ -300,7 +326,7 @@ protected:
     }
 
     // same button for start/stop
-    if (isRunning(status)) {
+    if (anyRunning()) {
       // highlight button for abort
       GuiSetStyle(BUTTON, BASE_COLOR_NORMAL, GuiGetStyle(DEFAULT, BASE_COLOR_PRESSED));
       GuiSetStyle(BUTTON, TEXT_COLOR_NORMAL, GuiGetStyle(DEFAULT, TEXT_COLOR_PRESSED));
@@ -324,7 +350,7 @@ protected:
     }
 
     // disable part of the UI during play
-    if (isRunning(status)) {
+    if (anyRunning()) {
       GuiSetState(STATE_DISABLED);
     }
 
@@ -342,6 +368,8 @@ protected:
       if (uiPreset >= NB_PRESETS - 1) {
 	uiPreset = 0;
       }
+      // all at once for the DSP, never a block with the new root and the old scale
+      setParameterValue(kParameterGroup, 1);
       if (presets[uiPreset].root >= 0 && presets[uiPreset].root != root) {
 	setParameterValue(kRoot, presets[uiPreset].root);
       }
@@ -353,6 +381,7 @@ protected:
 	  setParameterValue(kScaleC + i, !scale[i]);
 	}
       }
+      setParameterValue(kParameterGroup, 0);
     }
     
     // An additional button (aligned with Start) on the web to ask for webmidi permission
@@ -360,6 +389,17 @@ protected:
     if (supportsMIDI() && !isMIDIEnabled() && GuiButton(layoutRecs[4], "Enable WebMIDI")) {
       requestMIDI();
     }
+#else
+    // at the same place, a MIDI file for the melody mode, through the file browser of the host, and which track to learn
+    if (GuiButton(layoutRecs[46], melodyName[0] != '\0' ? melodyName : "Load melody...")) {
+      requestStateFile(MELODY_KEY);
+    }
+    int uiMelodyTrack = melodyTrack;
+    GuiComboBox(layoutRecs[47], "Top;1;2;3;4;5;6;7;8;9;10;11;12;13;14;15;16", &uiMelodyTrack);
+    if (uiMelodyTrack != melodyTrack) {
+      melodyTrack = uiMelodyTrack;
+      setParameterValue(kMelodyTrack, uiMelodyTrack);
+    }
 #endif
 
     // sync root note
@@ -430,7 +470,65 @@ protected:
       }
     }
 
-    // NOTE: no need to go back to default style for toggle as it is no used (yet?) elsewhere
+    // back to default style for toggle, used for pass-through below
+    GuiSetStyle(TOGGLE, BORDER_COLOR_NORMAL, GuiGetStyle(DEFAULT, BORDER_COLOR_NORMAL));
+    GuiSetStyle(TOGGLE, BASE_COLOR_NORMAL, GuiGetStyle(DEFAULT, BASE_COLOR_NORMAL));
+    GuiSetStyle(TOGGLE, TEXT_COLOR_NORMAL, GuiGetStyle(DEFAULT, TEXT_COLOR_NORMAL));
+    GuiSetStyle(TOGGLE, BORDER_COLOR_FOCUSED, GuiGetStyle(DEFAULT, BORDER_COLOR_FOCUSED));
+    GuiSetStyle(TOGGLE, BASE_COLOR_FOCUSED, GuiGetStyle(DEFAULT, BASE_COLOR_FOCUSED));
+    GuiSetStyle(TOGGLE, TEXT_COLOR_FOCUSED, GuiGetStyle(DEFAULT, TEXT_COLOR_FOCUSED));
+    GuiSetStyle(TOGGLE, BORDER_COLOR_PRESSED, GuiGetStyle(DEFAULT, BORDER_COLOR_PRESSED));
+    GuiSetStyle(TOGGLE, BASE_COLOR_PRESSED, GuiGetStyle(DEFAULT, BASE_COLOR_PRESSED));
+    GuiSetStyle(TOGGLE, TEXT_COLOR_PRESSED, GuiGetStyle(DEFAULT, TEXT_COLOR_PRESSED));
+    GuiSetStyle(TOGGLE, BORDER_COLOR_DISABLED, GuiGetStyle(DEFAULT, BORDER_COLOR_DISABLED));
+    GuiSetStyle(TOGGLE, BASE_COLOR_DISABLED, GuiGetStyle(DEFAULT, BASE_COLOR_DISABLED));
+    GuiSetStyle(TOGGLE, TEXT_COLOR_DISABLED, GuiGetStyle(DEFAULT, TEXT_COLOR_DISABLED));
+
+    // timings of instructions, fixed for the duration of a game
+    float uiInterval = intervalMs;
+    GuiLabel(layoutRecs[27], TextFormat("Interval: %d ms", (int)uiInterval));
+    GuiSliderBar(layoutRecs[28], NULL, NULL, &uiInterval, params[kInterval].min, params[kInterval].max);
+    if ((int)uiInterval != intervalMs) {
+      intervalMs = (int)uiInterval;
+      setParameterValue(kInterval, (int)uiInterval);
+    }
+    float uiDuration = durationMs;
+    GuiLabel(layoutRecs[29], TextFormat("Duration: %d ms", (int)uiDuration));
+    GuiSliderBar(layoutRecs[30], NULL, NULL, &uiDuration, params[kDuration].min, params[kDuration].max);
+    if ((int)uiDuration != durationMs) {
+      durationMs = (int)uiDuration;
+      setParameterValue(kDuration, (int)uiDuration);
+    }
+    // same order as Curve
+    int uiCurve = intervalCurve;
+    GuiComboBox(layoutRecs[31], "Flat;Linear;Exponential;Stepped", &uiCurve);
+    if (uiCurve != intervalCurve) {
+      intervalCurve = uiCurve;
+      setParameterValue(kCurve, uiCurve);
+    }
+    float uiSpeedUp = intervalSpeedUp;
+    GuiLabel(layoutRecs[32], TextFormat("Speed-up: %d%%", (int)uiSpeedUp));
+    GuiSliderBar(layoutRecs[33], NULL, NULL, &uiSpeedUp, params[kSpeedUp].min, params[kSpeedUp].max);
+    if ((int)uiSpeedUp != intervalSpeedUp) {
+      intervalSpeedUp = (int)uiSpeedUp;
+      setParameterValue(kSpeedUp, (int)uiSpeedUp);
+    }
+
+    // one game per input channel above one player
+    float uiNbLanes = nbLanes;
+    GuiSliderBar(layoutRecs[44], TextFormat("Players: %d", (int)uiNbLanes), NULL, &uiNbLanes, params[kLanes].min, params[kLanes].max);
+    if ((int)uiNbLanes != nbLanes) {
+      nbLanes = (int)uiNbLanes;
+      setParameterValue(kLanes, (int)uiNbLanes);
+    }
+
+    // melody instead of random notes, root, number of keys and scale follow
+    bool uiMelody = melodyMode;
+    GuiCheckBox(layoutRecs[45], melodyLength > 0 ? TextFormat("Melody: %d notes", melodyLength) : "Melody", &uiMelody);
+    if (uiMelody != melodyMode) {
+      melodyMode = uiMelody;
+      setParameterValue(kMelody, uiMelody);
+    }
 
     ClearBackground(GetColor(GuiGetStyle(DEFAULT, BACKGROUND_COLOR))); 
 
@@ -455,6 +553,52 @@ protected:
       setParameterValue(kRoundsForMiss, (int)uiRoundsForMiss);
     }
 
+    // sync debounce, with feedback about what it does
+    float uiDebounce = debounce;
+    GuiSliderBar(layoutRecs[25], TextFormat("Debounce: %d ms", (int)uiDebounce), TextFormat("%d filtered", nbFiltered), &uiDebounce, params[kDebounce].min, params[kDebounce].max);
+    if ((int)uiDebounce != debounce) {
+      debounce = (int)uiDebounce;
+      setParameterValue(kDebounce, (int)uiDebounce);
+    }
+
+    // rhythm, can be changed during a game
+    float uiTolerance = tolerance;
+    GuiLabel(layoutRecs[35], uiTolerance > 0 ? TextFormat("Rhythm: %d ms", (int)uiTolerance) : "Rhythm: off");
+    GuiSliderBar(layoutRecs[36], NULL, NULL, &uiTolerance, params[kTolerance].min, params[kTolerance].max);
+    if ((int)uiTolerance != tolerance) {
+      tolerance = (int)uiTolerance;
+      setParameterValue(kTolerance, (int)uiTolerance);
+    }
+
+    // which messages besides notes go through, same order as PassThrough
+    static const char *passThroughNames[] = {"CC", "Prg", "Bend", "Pres", "Poly", "Sys"};
+    for (int i = 0; i < 6; i++) {
+      bool passToggle = passThrough & (1 << i);
+      GuiToggle(layoutRecs[38 + i], passThroughNames[i], &passToggle);
+      if (passToggle != (bool)(passThrough & (1 << i))) {
+	passThrough ^= (1 << i);
+	setParameterValue(kPassThrough, passThrough);
+      }
+    }
+
+    // option about following host tempo
+    bool uiTempoSync = tempoSync;
+    GuiCheckBox(layoutRecs[26], "Sync to host tempo", &uiTempoSync);
+    if (uiTempoSync != tempoSync) {
+      tempoSync = uiTempoSync;
+      setParameterValue(kTempoSync, uiTempoSync);
+    }
+
+    // listen to audio input instead of or along MIDI, only in the audio variant
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+    bool uiAudioInput = audioInput;
+    GuiCheckBox(layoutRecs[48], "Audio in", &uiAudioInput);
+    if (uiAudioInput != audioInput) {
+      audioInput = uiAudioInput;
+      setParameterValue(kAudioInput, uiAudioInput);
+    }
+#endif
+
     // render the 3D scene
     DrawTexturePro(
 		   canvasPiano.texture,
@@ -463,8 +607,23 @@ protected:
 		   (Rectangle){layoutRecs[22].x, layoutRecs[22].y, layoutRecs[22].width, layoutRecs[22].height },
 		   (Vector2){ 0, 0 }, 0.0f, WHITE);
 
+    // scoreboard over the scene with several players, the scene only follows the first one
+    if (nbLanes > 1) {
+      // same order as Status
+      static const char *statusNames[] = {"Waiting", "Starting", "Listen", "Play", "Play", "Play", "Miss", "Lost", "Over"};
+      const Rectangle &board = layoutRecs[22];
+      DrawRectangleRec(board, Fade(GetColor(GuiGetStyle(DEFAULT, BACKGROUND_COLOR)), 0.85f));
+      for (int lane = 0; lane < nbLanes && lane < MAX_LANES; lane++) {
+	const int laneStatus = values[laneParameter(lane, LANE_STATUS)];
+	const Rectangle cell = { board.x + 8 + (lane % 4) * board.width / 4, board.y + (lane / 4) * board.height / 4, board.width / 4 - 8, board.height / 4 };
+	GuiLabel(cell, TextFormat("%d: %s - round %d, miss %d", lane + 1, laneStatus >= 0 && laneStatus < STATUS_COUNT ? statusNames[laneStatus] : "?", values[laneParameter(lane, LANE_ROUND)], values[laneParameter(lane, LANE_MISS)]));
+      }
+    }
+
     GuiLabel(layoutRecs[23], TextFormat("Missed %d/%d", nbMiss, maxMiss));
     GuiLabel(layoutRecs[24], TextFormat("Current best: %d", maxRound));
+    GuiLabel(layoutRecs[34], TextFormat("Tempo: %d BPM", tempo));
+    GuiLabel(layoutRecs[37], TextFormat("Timing: %+d ms, jitter %d ms", timingMean, timingJitter));
 
     DrawFPS(10, 10);
   }
@@ -477,14 +636,14 @@ private:
   // upper left reference point for UI
   static constexpr Vector2 anchor = { 15, 10 };
   // layout of the GUI
-  const Rectangle layoutRecs[25] = {
+  const Rectangle layoutRecs[49] = {
     (Rectangle){ anchor.x + 200, anchor.y + 0, 568, 32 },
     (Rectangle){ anchor.x + 200, anchor.y + 40, 568, 32 },
     (Rectangle){ anchor.x + 200, anchor.y + 80, 120, 32 },
     (Rectangle){ anchor.x + 336, anchor.y + 80, 224, 32 },
     (Rectangle){ anchor.x + 576, anchor.y + 80, 192, 32 },
-    (Rectangle){ anchor.x + 200, anchor.y + 120, 568, 32 },
-    (Rectangle){ anchor.x + 200, anchor.y + 160, 568, 32 },
+    (Rectangle){ anchor.x + 336, anchor.y + 120, 432, 32 },
+    (Rectangle){ anchor.x + 336, anchor.y + 160, 432, 32 },
     (Rectangle){ anchor.x + 48, anchor.y + 200, 144, 32 },
     (Rectangle){ anchor.x + 200, anchor.y + 200, 40, 32 },
     (Rectangle){ anchor.x + 248, anchor.y + 200, 40, 32 },
@@ -503,6 +662,30 @@ private:
     (Rectangle){ anchor.x + 0, anchor.y + 320, 768, 136 },
     (Rectangle){ anchor.x + 200, anchor.y + 464, 568, 32 },
     (Rectangle){ anchor.x + 200, anchor.y + 504, 568, 32 },
+    (Rectangle){ anchor.x + 500, anchor.y + 240, 180, 32 },
+    (Rectangle){ anchor.x + 500, anchor.y + 504, 32, 32 },
+    (Rectangle){ anchor.x + 0, anchor.y + 40, 180, 20 },
+    (Rectangle){ anchor.x + 0, anchor.y + 60, 180, 16 },
+    (Rectangle){ anchor.x + 0, anchor.y + 80, 180, 20 },
+    (Rectangle){ anchor.x + 0, anchor.y + 100, 180, 16 },
+    (Rectangle){ anchor.x + 0, anchor.y + 124, 180, 24 },
+    (Rectangle){ anchor.x + 0, anchor.y + 152, 180, 20 },
+    (Rectangle){ anchor.x + 0, anchor.y + 172, 180, 16 },
+    (Rectangle){ anchor.x + 0, anchor.y + 464, 180, 32 },
+    (Rectangle){ anchor.x + 0, anchor.y + 240, 180, 20 },
+    (Rectangle){ anchor.x + 0, anchor.y + 260, 180, 16 },
+    (Rectangle){ anchor.x + 0, anchor.y + 504, 180, 32 },
+    (Rectangle){ anchor.x + 0, anchor.y + 284, 28, 24 },
+    (Rectangle){ anchor.x + 30, anchor.y + 284, 28, 24 },
+    (Rectangle){ anchor.x + 60, anchor.y + 284, 28, 24 },
+    (Rectangle){ anchor.x + 90, anchor.y + 284, 28, 24 },
+    (Rectangle){ anchor.x + 120, anchor.y + 284, 28, 24 },
+    (Rectangle){ anchor.x + 150, anchor.y + 284, 28, 24 },
+    (Rectangle){ anchor.x + 680, anchor.y + 468, 88, 24 },
+    (Rectangle){ anchor.x + 340, anchor.y + 468, 24, 24 },
+    (Rectangle){ anchor.x + 576, anchor.y + 80, 120, 32 },
+    (Rectangle){ anchor.x + 704, anchor.y + 80, 64, 32 },
+    (Rectangle){ anchor.x + 680, anchor.y + 504, 32, 32 },
   };
 
   // used for 3D rendering
@@ -521,7 +704,7 @@ private:
   // how long in current anim we are
   float animCurrentTime = 0;
   // status for animation
-  int animNote = params[kCurNote].def;
+  unsigned int animNoteOnCount = 0;
   int animStatus = params[kStatus].def;
   // render texture to mesh
   RenderTexture2D texturePiano;
@@ -529,19 +712,126 @@ private:
   RenderTexture2D canvasPiano;
 
 
-  // parameters sync with DSP
+  // parameters sync with DSP, last values received, indexed as Parameters
+  int values[kParameterCount];
+  // only taking into account what is currently used in the DSP for UI
+  int &root = values[kEffectiveRoot];
+  int &nbNotes = values[kEffectiveNbNotes];
+  int *const scale = values + kEffectiveScaleC;
+  int &roundsForMiss = values[kRoundsForMiss];
+  int &maxMiss = values[kMaxMiss];
+  int &maxRound = values[kMaxRound];
+  int &shallNotPass = values[kShallNotPass];
+  int &debounce = values[kDebounce];
+  int &tempoSync = values[kTempoSync];
+  int &intervalMs = values[kInterval];
+  int &durationMs = values[kDuration];
+  int &intervalCurve = values[kCurve];
+  int &intervalSpeedUp = values[kSpeedUp];
+  int &tempo = values[kTempo];
+  int &tolerance = values[kTolerance];
+  int &timingMean = values[kTimingMean];
+  int &timingJitter = values[kTimingJitter];
+  int &passThrough = values[kPassThrough];
+  int &nbLanes = values[kLanes];
+  int &nbFiltered = values[kFiltered];
+  int &melodyMode = values[kMelody];
+  int &melodyTrack = values[kMelodyTrack];
+  int &melodyLength = values[kMelodyLength];
+  int &audioInput = values[kAudioInput];
+  // file name of the melody, without its folder, empty if none
+  char melodyName[64] = {0};
+  // game state, from events if possible or else from values
   int status = params[kStatus].def;
-  int root = params[kRoot].def;
-  int nbNotes = params[kNbNotes].def;
   int curNote = params[kCurNote].def;
   int round = params[kRound].def;
   int step = params[kStep].def;
-  bool scale[12] = {0};
-  int roundsForMiss = params[kRoundsForMiss].def;
   int nbMiss = params[kNbMiss].def;
-  int maxMiss = params[kMaxMiss].def;
-  int maxRound = params[kMaxRound].def;
-  bool shallNotPass = params[kShallNotPass].def;
+
+  // events from DSP, nullptr if not in the same binary
+  GameEventStream *events = nullptr;
+  uint32_t eventsId = 0;
+  // increased upon each new note, even if released before next frame
+  unsigned int noteOnCount = 0;
+  // last note played since last frame and status at the time, -1 if none
+  int flashNote = -1;
+  int flashStatus = params[kStatus].def;
+  // note and status used to draw keys
+  int keyNote = params[kCurNote].def;
+  int keyStatus = params[kStatus].def;
+
+  // keep track of new notes for animations and display
+  void setCurNote(int note) {
+    if (note >= 0 && note != curNote) {
+      noteOnCount++;
+      flashNote = note;
+      flashStatus = status;
+    }
+    curNote = note;
+  }
+
+  // game of any player in progress, from outputs of the players besides the first one
+  bool anyRunning() const {
+    if (isRunning(status)) {
+      return true;
+    }
+    for (int lane = 1; lane < nbLanes && lane < MAX_LANES; lane++) {
+      if (isRunning(values[laneParameter(lane, LANE_STATUS)])) {
+	return true;
+      }
+    }
+    return false;
+  }
+
+  // back to last values sent through parameters
+  void resync() {
+    status = values[kStatus];
+    setCurNote(values[kCurNote]);
+    round = values[kRound];
+    step = values[kStep];
+    nbMiss = values[kNbMiss];
+  }
+
+  // apply events sent by DSP since last call, in order
+  void drainEvents() {
+    if (events == nullptr) {
+      return;
+    }
+    // stream was given to another instance, stick to parameters
+    if (events->owner.load() != eventsId) {
+      events = nullptr;
+      resync();
+      return;
+    }
+    // we missed some events, start over from parameters
+    if (events->dropped.exchange(0) > 0) {
+      events->queue.clear();
+      resync();
+      return;
+    }
+    GameEvent event;
+    while (events->queue.pop(event)) {
+      switch (event.type) {
+      case EV_STATUS:
+	status = event.value;
+	break;
+      case EV_ROUND:
+	round = event.value;
+	break;
+      case EV_STEP:
+	step = event.value;
+	break;
+      case EV_MISS:
+	nbMiss = event.value;
+	break;
+      case EV_NOTE:
+	setCurNote(event.value);
+	break;
+      default:
+	break;
+      }
+    }
+  }
 
   // extract and draw sprite id a said location and size
   // also background, hacking slightly
@@ -665,8 +955,8 @@ private:
 	  sprite = WHITE_KEY;
 	}
 	// this note currently active, special color
-	if ((int)note == curNote) {
-	  switch(status) {
+	if ((int)note == keyNote) {
+	  switch(keyStatus) {
 	  case INSTRUCTIONS:
 	    sprite = WHITE_KEY_INSTRUCTION;
 	    break;
@@ -704,8 +994,8 @@ private:
 	  sprite = BLACK_KEY;
 	}
 	// this note currently active, special color
-	if ((int)note == curNote) {
-	  switch(status) {
+	if ((int)note == keyNote) {
+	  switch(keyStatus) {
 	  case INSTRUCTIONS:
 	    sprite = BLACK_KEY_INSTRUCTION;
 	    break;
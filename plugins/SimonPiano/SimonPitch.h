@@ -0,0 +1,406 @@
+
+#ifndef SIMON_PITCH_H
+#define SIMON_PITCH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "SimonSimd.h"
+
+// analysis window in seconds, rounded up to a power of 2 -- lags up to half of it, i.e. down to about 47 Hz at 48 kHz
+#define PITCH_WINDOW_SECONDS 0.04
+// fixed upper bound so that everything is preallocated, lowest notes are lost above 96 kHz
+#define PITCH_MAX_WINDOW 4096
+#define PITCH_MIN_WINDOW 256
+#define PITCH_MAX_FFT (2 * PITCH_MAX_WINDOW)
+// highest note of a piano is about 4186 Hz
+#define PITCH_MAX_FREQUENCY 4500
+// MPM: first key maximum above that ratio of the highest one, against octave errors
+#define PITCH_PEAK_RATIO 0.93f
+#define PITCH_MAX_PEAKS 64
+// how periodic the signal must be for a pitch (1: perfectly), and below which the note is lost
+#define PITCH_CLARITY 0.8f
+#define PITCH_CLARITY_OFF 0.5f
+// hops with the same note before it is played, hops without clear pitch before it is released
+#define PITCH_CONFIRM_HOPS 2
+#define PITCH_UNCLEAR_HOPS 4
+// level rise from one hop to the next that strikes the note again, and margin under the gate before release, in dB
+#define PITCH_ONSET_DB 6
+#define PITCH_RELEASE_DB 6
+
+// frequency in Hz, 0 if none, and how periodic the window is (normalized autocorrelation at that period)
+struct PitchEstimate {
+  float frequency;
+  float clarity;
+};
+
+// Monophonic pitch of a window with the McLeod pitch method: normalized square difference from the autocorrelation, computed with two FFTs.
+// Tables and buffers are preallocated for the largest window, only sized upon sample rate change.
+class PitchTracker {
+
+ public:
+  PitchTracker() {
+    setSampleRate(48000);
+  }
+
+  // not real-time safe: tables are computed again
+  void setSampleRate(double newSampleRate) {
+    sampleRate = newSampleRate > 0 ? newSampleRate : 48000;
+    windowSize = PITCH_MIN_WINDOW;
+    while (windowSize < PITCH_WINDOW_SECONDS * sampleRate && windowSize < PITCH_MAX_WINDOW) {
+      windowSize *= 2;
+    }
+    // zero padded, so that circular autocorrelation is the linear one
+    fftSize = 2 * windowSize;
+    int nbBits = 0;
+    while ((1u << nbBits) < fftSize) {
+      nbBits++;
+    }
+    for (uint32_t i = 0; i < fftSize; i++) {
+      uint32_t reversed = 0;
+      for (int b = 0; b < nbBits; b++) {
+        reversed |= ((i >> b) & 1) << (nbBits - 1 - b);
+      }
+      bitReverse[i] = reversed;
+    }
+    // twiddles of each stage one after the other, stage of half span h at offset h - 1
+    for (uint32_t half = 1; half < fftSize; half *= 2) {
+      for (uint32_t k = 0; k < half; k++) {
+        const double angle = -3.14159265358979323846 * k / half;
+        twiddleRe[half - 1 + k] = cos(angle);
+        twiddleIm[half - 1 + k] = sin(angle);
+      }
+    }
+    minLag = sampleRate / PITCH_MAX_FREQUENCY;
+    if (minLag < 2) {
+      minLag = 2;
+    }
+  }
+
+  // number of samples expected by estimate()
+  uint32_t getWindowSize() const {
+    return windowSize;
+  }
+
+  // window: getWindowSize() samples, oldest first
+  PitchEstimate estimate(const float *window) {
+    // autocorrelation: power spectrum of the padded window, transformed again (real and symmetric, forward is inverse times size)
+    memcpy(re, window, windowSize * sizeof(float));
+    memset(re + windowSize, 0, (fftSize - windowSize) * sizeof(float));
+    memset(im, 0, fftSize * sizeof(float));
+    fft();
+    for (uint32_t i = 0; i < fftSize; i += 4) {
+      const Float4 r = f4Load(re + i);
+      const Float4 m = f4Load(im + i);
+      f4Store(re + i, f4Add(f4Mul(r, r), f4Mul(m, m)));
+      f4Store(im + i, f4Set(0));
+    }
+    fft();
+    // normalized square difference, energy of the overlapping part updated lag after lag
+    const uint32_t maxLag = windowSize / 2;
+    const float scale = 1.0f / fftSize;
+    double energy = 0;
+    for (uint32_t i = 0; i < windowSize; i++) {
+      energy += window[i] * window[i];
+    }
+    PitchEstimate none = {0, 0};
+    if (energy <= 0) {
+      return none;
+    }
+    double m = 2 * energy;
+    for (uint32_t lag = 0; lag < maxLag; lag++) {
+      if (lag > 0) {
+        m -= window[lag - 1] * window[lag - 1] + window[windowSize - lag] * window[windowSize - lag];
+      }
+      nsdf[lag] = m > 0 ? 2 * re[lag] * scale / m : 0;
+    }
+    // key maxima: highest point between a positive-going zero crossing and the next negative-going one
+    int nbPeaks = 0;
+    uint32_t lag = 1;
+    while (lag < maxLag && nsdf[lag] > 0) {
+      lag++;
+    }
+    while (lag < maxLag && nbPeaks < PITCH_MAX_PEAKS) {
+      while (lag < maxLag && nsdf[lag] <= 0) {
+        lag++;
+      }
+      uint32_t best = lag;
+      while (lag < maxLag && nsdf[lag] > 0) {
+        if (nsdf[lag] > nsdf[best]) {
+          best = lag;
+        }
+        lag++;
+      }
+      // a lobe cut by the end of the window is not a maximum
+      if (lag < maxLag && best >= minLag) {
+        peaks[nbPeaks++] = best;
+      }
+    }
+    if (nbPeaks == 0) {
+      return none;
+    }
+    float highest = 0;
+    for (int i = 0; i < nbPeaks; i++) {
+      highest = nsdf[peaks[i]] > highest ? nsdf[peaks[i]] : highest;
+    }
+    uint32_t period = peaks[0];
+    for (int i = 0; i < nbPeaks; i++) {
+      if (nsdf[peaks[i]] >= PITCH_PEAK_RATIO * highest) {
+        period = peaks[i];
+        break;
+      }
+    }
+    // parabola through the peak and its neighbors, for a period between samples
+    const float left = nsdf[period - 1];
+    const float center = nsdf[period];
+    const float right = nsdf[period + 1];
+    const float curvature = left - 2 * center + right;
+    float shift = curvature < 0 ? 0.5f * (left - right) / curvature : 0;
+    shift = shift < -0.5f ? -0.5f : shift > 0.5f ? 0.5f : shift;
+    PitchEstimate found = {(float) (sampleRate / (period + shift)), center - 0.25f * (left - right) * shift};
+    return found;
+  }
+
+ private:
+  double sampleRate = 48000;
+  uint32_t windowSize = PITCH_MIN_WINDOW;
+  uint32_t fftSize = 2 * PITCH_MIN_WINDOW;
+  uint32_t minLag = 2;
+  // split complex, 4 at a time
+  alignas(16) float re[PITCH_MAX_FFT];
+  alignas(16) float im[PITCH_MAX_FFT];
+  alignas(16) float twiddleRe[PITCH_MAX_FFT];
+  alignas(16) float twiddleIm[PITCH_MAX_FFT];
+  uint16_t bitReverse[PITCH_MAX_FFT];
+  float nsdf[PITCH_MAX_WINDOW / 2];
+  uint32_t peaks[PITCH_MAX_PEAKS];
+
+  // in place, radix 2, decimation in time. First two stages one butterfly at a time, then 4 butterflies at once.
+  void fft() {
+    for (uint32_t i = 0; i < fftSize; i++) {
+      const uint32_t j = bitReverse[i];
+      if (i < j) {
+        float tmp = re[i];
+        re[i] = re[j];
+        re[j] = tmp;
+        tmp = im[i];
+        im[i] = im[j];
+        im[j] = tmp;
+      }
+    }
+    // half span 1 and 2: twiddles are 1 and -i
+    for (uint32_t i = 0; i < fftSize; i += 4) {
+      float *r = re + i;
+      float *m = im + i;
+      const float r0 = r[0] + r[1], m0 = m[0] + m[1];
+      const float r1 = r[0] - r[1], m1 = m[0] - m[1];
+      const float r2 = r[2] + r[3], m2 = m[2] + m[3];
+      const float r3 = r[2] - r[3], m3 = m[2] - m[3];
+      r[0] = r0 + r2;
+      m[0] = m0 + m2;
+      r[2] = r0 - r2;
+      m[2] = m0 - m2;
+      // times -i
+      r[1] = r1 + m3;
+      m[1] = m1 - r3;
+      r[3] = r1 - m3;
+      m[3] = m1 + r3;
+    }
+    for (uint32_t half = 4; half < fftSize; half *= 2) {
+      const float *wr = twiddleRe + half - 1;
+      const float *wi = twiddleIm + half - 1;
+      for (uint32_t start = 0; start < fftSize; start += 2 * half) {
+        float *ar = re + start;
+        float *ai = im + start;
+        float *br = ar + half;
+        float *bi = ai + half;
+        for (uint32_t k = 0; k < half; k += 4) {
+          // twiddles of a stage are not aligned, see offsets
+          const Float4 cr = f4LoadUnaligned(wr + k);
+          const Float4 ci = f4LoadUnaligned(wi + k);
+          const Float4 xr = f4Load(br + k);
+          const Float4 xi = f4Load(bi + k);
+          const Float4 tr = f4Sub(f4Mul(xr, cr), f4Mul(xi, ci));
+          const Float4 ti = f4Add(f4Mul(xr, ci), f4Mul(xi, cr));
+          const Float4 yr = f4Load(ar + k);
+          const Float4 yi = f4Load(ai + k);
+          f4Store(ar + k, f4Add(yr, tr));
+          f4Store(ai + k, f4Add(yi, ti));
+          f4Store(br + k, f4Sub(yr, tr));
+          f4Store(bi + k, f4Sub(yi, ti));
+        }
+      }
+    }
+  }
+};
+
+// note detected in audio input, frame within the block
+struct DetectedNote {
+  uint32_t frame;
+  bool on;
+  uint8_t note;
+  uint8_t velocity;
+};
+
+// Notes out of a monophonic audio input, e.g. an acoustic piano in front of a microphone: a pitch every hop over the latest window,
+// a note once the same one is found for a few hops above the gate, released when the level drops or the pitch is lost, struck again upon a sudden rise.
+class AudioNoteDetector {
+
+ public:
+  AudioNoteDetector() {
+    reset();
+  }
+
+  // not real-time safe, see PitchTracker
+  void setSampleRate(double newSampleRate) {
+    sampleRate = newSampleRate > 0 ? newSampleRate : 48000;
+    tracker.setSampleRate(sampleRate);
+    updateHop();
+    reset();
+  }
+
+  // time between two analyses, in ms: shorter for less latency, longer for less CPU
+  void setHop(int ms) {
+    hopMs = ms;
+    updateHop();
+  }
+
+  // level under which nothing is detected, in dB
+  void setGate(int dB) {
+    gate = dB;
+  }
+
+  // forget what was heard, without any event -- see release()
+  void reset() {
+    memset(history, 0, sizeof(history));
+    historyPos = 0;
+    hopFill = 0;
+    hopEnergy = 0;
+    lastLevel = -200;
+    candidate = -1;
+    candidateHops = 0;
+    unclearHops = 0;
+    sounding = -1;
+  }
+
+  // note currently on, -1 if none
+  int getSounding() const {
+    return sounding;
+  }
+
+  // note off for the sounding note, if any, then reset. return number of notes written, at most 1
+  uint32_t release(uint32_t frame, DetectedNote *notes) {
+    uint32_t nb = 0;
+    if (sounding >= 0) {
+      notes[nb++] = {frame, false, (uint8_t) sounding, 0};
+    }
+    reset();
+    return nb;
+  }
+
+  // listen to a block, input nullptr for silence. Notes are written in order, return their number, at most maxNotes (later ones are lost).
+  uint32_t process(const float *input, uint32_t nbFrames, DetectedNote *notes, uint32_t maxNotes) {
+    uint32_t nbNotes = 0;
+    const uint32_t windowSize = tracker.getWindowSize();
+    uint32_t i = 0;
+    while (i < nbFrames) {
+      const uint32_t chunk = nbFrames - i < hopSize - hopFill ? nbFrames - i : hopSize - hopFill;
+      for (uint32_t j = 0; j < chunk; j++) {
+        const float sample = input != nullptr ? input[i + j] : 0;
+        history[historyPos] = sample;
+        historyPos = (historyPos + 1) % windowSize;
+        hopEnergy += sample * sample;
+      }
+      i += chunk;
+      hopFill += chunk;
+      if (hopFill >= hopSize) {
+        // oldest first
+        memcpy(window, history + historyPos, (windowSize - historyPos) * sizeof(float));
+        memcpy(window + windowSize - historyPos, history, historyPos * sizeof(float));
+        nbNotes += decide(i - 1, notes + nbNotes, maxNotes - nbNotes);
+        hopFill = 0;
+        hopEnergy = 0;
+      }
+    }
+    return nbNotes;
+  }
+
+ private:
+  PitchTracker tracker;
+  double sampleRate = 48000;
+  int hopMs = 5;
+  uint32_t hopSize = 240;
+  int gate = -40;
+  // latest samples, circular
+  alignas(16) float history[PITCH_MAX_WINDOW];
+  alignas(16) float window[PITCH_MAX_WINDOW];
+  uint32_t historyPos = 0;
+  // current hop
+  uint32_t hopFill = 0;
+  double hopEnergy = 0;
+  // level of previous hop in dB, note found over the last hops and since when, note on
+  float lastLevel = -200;
+  int candidate = -1;
+  int candidateHops = 0;
+  int unclearHops = 0;
+  int sounding = -1;
+
+  // at least one frame, at most a window
+  void updateHop() {
+    const double frames = hopMs * sampleRate / 1000;
+    hopSize = frames < 1 ? 1 : frames > tracker.getWindowSize() ? tracker.getWindowSize() : (uint32_t) frames;
+    hopFill = 0;
+    hopEnergy = 0;
+  }
+
+  // at the end of a hop: estimate then change notes if need be, return number of notes written (at most 2, and maxNotes)
+  uint32_t decide(uint32_t frame, DetectedNote *notes, uint32_t maxNotes) {
+    const float level = 10 * log10f(hopEnergy / hopSize + 1e-20);
+    int note = -1;
+    float clarity = 0;
+    if (level > gate - PITCH_RELEASE_DB) {
+      const PitchEstimate pitch = tracker.estimate(window);
+      clarity = pitch.clarity;
+      if (pitch.frequency > 0 && clarity >= PITCH_CLARITY) {
+        const int rounded = lroundf(69 + 12 * log2f(pitch.frequency / 440));
+        note = rounded >= 0 && rounded <= 127 ? rounded : -1;
+      }
+    }
+    if (note >= 0 && note == candidate) {
+      candidateHops++;
+    }
+    else {
+      candidate = note;
+      candidateHops = note >= 0 ? 1 : 0;
+    }
+    const bool onset = level > gate && level > lastLevel + PITCH_ONSET_DB;
+    const bool confirmed = candidate >= 0 && candidateHops >= PITCH_CONFIRM_HOPS;
+    lastLevel = level;
+    unclearHops = clarity < PITCH_CLARITY_OFF ? unclearHops + 1 : 0;
+    // velocity from the level above the gate
+    const float loudness = gate < 0 ? (level - gate) / -gate : 1;
+    const uint8_t velocity = 16 + 111 * (loudness < 0 ? 0 : loudness > 1 ? 1 : loudness);
+
+    uint32_t nb = 0;
+    if (sounding >= 0) {
+      const bool silent = level < gate - PITCH_RELEASE_DB || unclearHops >= PITCH_UNCLEAR_HOPS;
+      const bool moved = confirmed && candidate != sounding;
+      const bool struck = onset && candidate == sounding;
+      if ((silent || moved || struck) && nb < maxNotes) {
+        notes[nb++] = {frame, false, (uint8_t) sounding, 0};
+        sounding = -1;
+      }
+      if ((moved || struck) && nb < maxNotes) {
+        notes[nb++] = {frame, true, (uint8_t) candidate, velocity};
+        sounding = candidate;
+      }
+    }
+    else if (confirmed && level > gate && nb < maxNotes) {
+      notes[nb++] = {frame, true, (uint8_t) candidate, velocity};
+      sounding = candidate;
+    }
+    return nb;
+  }
+};
+
+#endif /* SIMON_PITCH_H */
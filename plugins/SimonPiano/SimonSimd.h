@@ -0,0 +1,92 @@
+
+#ifndef SIMON_SIMD_H
+#define SIMON_SIMD_H
+
+#include <string.h>
+#include <math.h>
+
+// 4 floats at once with what the target offers, plain floats otherwise
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SIMD_NEON 1
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define SIMD_WASM 1
+#endif
+
+// 4 floats and the few operations on them, data must be 16-byte aligned unless stated otherwise
+#if defined(SIMD_SSE)
+typedef __m128 Float4;
+inline Float4 f4Set(float value) { return _mm_set1_ps(value); }
+inline Float4 f4Load(const float *data) { return _mm_load_ps(data); }
+inline Float4 f4LoadUnaligned(const float *data) { return _mm_loadu_ps(data); }
+inline void f4Store(float *data, Float4 value) { _mm_store_ps(data, value); }
+inline Float4 f4Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 f4Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 f4Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 f4Max(Float4 a, Float4 b) { return _mm_max_ps(a, b); }
+inline Float4 f4Abs(Float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+// truncate, then one less where that went up
+inline Float4 f4Floor(Float4 a) {
+  const Float4 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+  return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+}
+inline float f4Sum(Float4 a) {
+  const Float4 pairs = _mm_add_ps(a, _mm_movehl_ps(a, a));
+  return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+#elif defined(SIMD_NEON)
+typedef float32x4_t Float4;
+inline Float4 f4Set(float value) { return vdupq_n_f32(value); }
+inline Float4 f4Load(const float *data) { return vld1q_f32(data); }
+inline Float4 f4LoadUnaligned(const float *data) { return vld1q_f32(data); }
+inline void f4Store(float *data, Float4 value) { vst1q_f32(data, value); }
+inline Float4 f4Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 f4Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+inline Float4 f4Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+inline Float4 f4Max(Float4 a, Float4 b) { return vmaxq_f32(a, b); }
+inline Float4 f4Abs(Float4 a) { return vabsq_f32(a); }
+inline Float4 f4Floor(Float4 a) {
+  const Float4 t = vcvtq_f32_s32(vcvtq_s32_f32(a));
+  return vsubq_f32(t, vreinterpretq_f32_u32(vandq_u32(vcgtq_f32(t, a), vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+}
+inline float f4Sum(Float4 a) {
+  const float32x2_t pairs = vadd_f32(vget_low_f32(a), vget_high_f32(a));
+  return vget_lane_f32(vpadd_f32(pairs, pairs), 0);
+}
+#elif defined(SIMD_WASM)
+typedef v128_t Float4;
+inline Float4 f4Set(float value) { return wasm_f32x4_splat(value); }
+inline Float4 f4Load(const float *data) { return wasm_v128_load(data); }
+inline Float4 f4LoadUnaligned(const float *data) { return wasm_v128_load(data); }
+inline void f4Store(float *data, Float4 value) { wasm_v128_store(data, value); }
+inline Float4 f4Add(Float4 a, Float4 b) { return wasm_f32x4_add(a, b); }
+inline Float4 f4Sub(Float4 a, Float4 b) { return wasm_f32x4_sub(a, b); }
+inline Float4 f4Mul(Float4 a, Float4 b) { return wasm_f32x4_mul(a, b); }
+inline Float4 f4Max(Float4 a, Float4 b) { return wasm_f32x4_max(a, b); }
+inline Float4 f4Abs(Float4 a) { return wasm_f32x4_abs(a); }
+inline Float4 f4Floor(Float4 a) { return wasm_f32x4_floor(a); }
+inline float f4Sum(Float4 a) {
+  return wasm_f32x4_extract_lane(a, 0) + wasm_f32x4_extract_lane(a, 1) + wasm_f32x4_extract_lane(a, 2) + wasm_f32x4_extract_lane(a, 3);
+}
+#else
+struct Float4 {
+  float v[4];
+};
+inline Float4 f4Set(float value) { return {{value, value, value, value}}; }
+inline Float4 f4Load(const float *data) { return {{data[0], data[1], data[2], data[3]}}; }
+inline Float4 f4LoadUnaligned(const float *data) { return f4Load(data); }
+inline void f4Store(float *data, Float4 value) { memcpy(data, value.v, sizeof(value.v)); }
+inline Float4 f4Add(Float4 a, Float4 b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+inline Float4 f4Sub(Float4 a, Float4 b) { return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+inline Float4 f4Mul(Float4 a, Float4 b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+inline Float4 f4Max(Float4 a, Float4 b) { return {{fmaxf(a.v[0], b.v[0]), fmaxf(a.v[1], b.v[1]), fmaxf(a.v[2], b.v[2]), fmaxf(a.v[3], b.v[3])}}; }
+inline Float4 f4Abs(Float4 a) { return {{fabsf(a.v[0]), fabsf(a.v[1]), fabsf(a.v[2]), fabsf(a.v[3])}}; }
+inline Float4 f4Floor(Float4 a) { return {{floorf(a.v[0]), floorf(a.v[1]), floorf(a.v[2]), floorf(a.v[3])}}; }
+inline float f4Sum(Float4 a) { return a.v[0] + a.v[1] + a.v[2] + a.v[3]; }
+#endif
+
+#endif /* SIMON_SIMD_H */
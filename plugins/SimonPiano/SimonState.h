@@ -0,0 +1,308 @@
+
+#ifndef SIMON_STATE_H
+#define SIMON_STATE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "DistrhoPluginInfo.h"
+#include "SimonUtils.h"
+
+// key of the state holding the session, value is the blob in base64
+#define STATE_KEY "session"
+
+// blob layout: magic, version, session fields then each lane in use, see writeSession()
+// integers are little endian whatever the machine, a project can be opened elsewhere
+#define STATE_MAGIC "SIMS"
+#define STATE_VERSION 1
+
+// game of one player, as saved
+struct LaneSession {
+  uint8_t status;
+  uint32_t round;
+  uint32_t nbMiss;
+  uint32_t maxMiss;
+  uint32_t lastRFM;
+  uint64_t gameKey;
+  // state of the number generator, to go on with the same sequence
+  uint64_t random;
+  // notes drawn so far, from the start of the sequence -- beyond MAX_ROUND they are derived from the key
+  uint8_t nbNotes;
+  uint8_t sequence[MAX_ROUND];
+};
+
+// everything worth keeping across sessions, fixed size so that it is exchanged without any allocation
+struct Session {
+  uint32_t seed;
+  int32_t maxRound;
+  uint8_t nbLanes;
+  LaneSession lanes[MAX_LANES];
+};
+
+// size of the blob: header, then each lane and its notes
+#define STATE_HEADER_SIZE (4 + 2 + 4 + 4 + 1)
+#define STATE_LANE_SIZE (1 + 4 * 4 + 8 + 8 + 1)
+#define STATE_MAX_SIZE (STATE_HEADER_SIZE + MAX_LANES * (STATE_LANE_SIZE + MAX_ROUND))
+// same in base64, with terminating null
+#define STATE_MAX_TEXT ((STATE_MAX_SIZE + 2) / 3 * 4 + 1)
+
+static_assert(MAX_ROUND <= 255, "number of notes in a lane is stored on a byte");
+
+// Little endian writes to a buffer large enough, i.e. STATE_MAX_SIZE
+class StateWriter {
+
+ public:
+  StateWriter(uint8_t *buffer) : buffer(buffer) {}
+
+  void u8(uint8_t value) {
+    buffer[size++] = value;
+  }
+  void u16(uint16_t value) {
+    u8(value);
+    u8(value >> 8);
+  }
+  void u32(uint32_t value) {
+    u16(value);
+    u16(value >> 16);
+  }
+  void u64(uint64_t value) {
+    u32(value);
+    u32(value >> 32);
+  }
+  void bytes(const uint8_t *data, uint32_t nbBytes) {
+    memcpy(buffer + size, data, nbBytes);
+    size += nbBytes;
+  }
+
+  uint32_t getSize() const {
+    return size;
+  }
+
+ private:
+  uint8_t *buffer;
+  uint32_t size = 0;
+};
+
+// Little endian reads, past the end everything is 0 and the reader is marked as failed
+class StateReader {
+
+ public:
+  StateReader(const uint8_t *data, uint32_t size) : data(data), size(size) {}
+
+  uint8_t u8() {
+    if (pos >= size) {
+      failed = true;
+      return 0;
+    }
+    return data[pos++];
+  }
+  uint16_t u16() {
+    const uint16_t low = u8();
+    return low | (uint16_t) u8() << 8;
+  }
+  uint32_t u32() {
+    const uint32_t low = u16();
+    return low | (uint32_t) u16() << 16;
+  }
+  uint64_t u64() {
+    const uint64_t low = u32();
+    return low | (uint64_t) u32() << 32;
+  }
+  void bytes(uint8_t *out, uint32_t nbBytes) {
+    if (nbBytes > size - pos) {
+      failed = true;
+      return;
+    }
+    memcpy(out, data + pos, nbBytes);
+    pos += nbBytes;
+  }
+
+  bool ok() const {
+    return !failed;
+  }
+
+ private:
+  const uint8_t *data;
+  uint32_t size;
+  uint32_t pos = 0;
+  bool failed = false;
+};
+
+// only lanes in use, and only notes drawn. return size of the blob
+inline uint32_t writeSession(const Session &session, uint8_t *buffer) {
+  StateWriter writer(buffer);
+  writer.bytes((const uint8_t *) STATE_MAGIC, 4);
+  writer.u16(STATE_VERSION);
+  writer.u32(session.seed);
+  writer.u32(session.maxRound);
+  writer.u8(session.nbLanes);
+  for (int lane = 0; lane < session.nbLanes; lane++) {
+    const LaneSession &saved = session.lanes[lane];
+    writer.u8(saved.status);
+    writer.u32(saved.round);
+    writer.u32(saved.nbMiss);
+    writer.u32(saved.maxMiss);
+    writer.u32(saved.lastRFM);
+    writer.u64(saved.gameKey);
+    writer.u64(saved.random);
+    writer.u8(saved.nbNotes);
+    writer.bytes(saved.sequence, saved.nbNotes);
+  }
+  return writer.getSize();
+}
+
+// return false if the blob is not a session we can read, session is then partially written
+// note: data after the last lane is ignored, room for fields appended by minor changes
+inline bool readSession(const uint8_t *data, uint32_t size, Session &session) {
+  StateReader reader(data, size);
+  uint8_t magic[4];
+  reader.bytes(magic, 4);
+  if (!reader.ok() || memcmp(magic, STATE_MAGIC, 4) != 0) {
+    return false;
+  }
+  const uint16_t version = reader.u16();
+  if (version < 1 || version > STATE_VERSION) {
+    return false;
+  }
+  session.seed = reader.u32();
+  session.maxRound = reader.u32();
+  session.nbLanes = reader.u8();
+  if (session.nbLanes < 1 || session.nbLanes > MAX_LANES) {
+    return false;
+  }
+  for (int lane = 0; lane < session.nbLanes; lane++) {
+    LaneSession &saved = session.lanes[lane];
+    saved.status = reader.u8();
+    saved.round = reader.u32();
+    saved.nbMiss = reader.u32();
+    saved.maxMiss = reader.u32();
+    saved.lastRFM = reader.u32();
+    saved.gameKey = reader.u64();
+    saved.random = reader.u64();
+    saved.nbNotes = reader.u8();
+    if (saved.status >= STATUS_COUNT || saved.nbNotes > MAX_ROUND || saved.round > MAX_ENDLESS_ROUND) {
+      return false;
+    }
+    // notes of past rounds are all drawn, only the one of current round may be drawn again upon restore
+    const uint32_t stored = saved.round < MAX_ROUND ? saved.round : MAX_ROUND;
+    if ((uint32_t) saved.nbNotes + 1 < stored) {
+      return false;
+    }
+    reader.bytes(saved.sequence, saved.nbNotes);
+  }
+  return reader.ok();
+}
+
+// standard alphabet, with padding
+static const char base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// text must hold (size + 2) / 3 * 4 + 1 characters, return length without terminating null
+inline uint32_t encodeBase64(const uint8_t *data, uint32_t size, char *text) {
+  uint32_t length = 0;
+  uint32_t i = 0;
+  for (; i + 2 < size; i += 3) {
+    const uint32_t triple = (uint32_t) data[i] << 16 | (uint32_t) data[i + 1] << 8 | data[i + 2];
+    text[length++] = base64Chars[(triple >> 18) & 63];
+    text[length++] = base64Chars[(triple >> 12) & 63];
+    text[length++] = base64Chars[(triple >> 6) & 63];
+    text[length++] = base64Chars[triple & 63];
+  }
+  // one or two bytes left
+  if (i < size) {
+    const uint32_t triple = (uint32_t) data[i] << 16 | (i + 1 < size ? (uint32_t) data[i + 1] << 8 : 0);
+    text[length++] = base64Chars[(triple >> 18) & 63];
+    text[length++] = base64Chars[(triple >> 12) & 63];
+    text[length++] = i + 1 < size ? base64Chars[(triple >> 6) & 63] : '=';
+    text[length++] = '=';
+  }
+  text[length] = '\0';
+  return length;
+}
+
+// value of a base64 character, -1 if not part of the alphabet
+inline int base64Value(char c) {
+  if (c >= 'A' && c <= 'Z') {
+    return c - 'A';
+  }
+  if (c >= 'a' && c <= 'z') {
+    return c - 'a' + 26;
+  }
+  if (c >= '0' && c <= '9') {
+    return c - '0' + 52;
+  }
+  if (c == '+') {
+    return 62;
+  }
+  if (c == '/') {
+    return 63;
+  }
+  return -1;
+}
+
+// stops at padding or end of text, whitespace is skipped
+// return number of bytes, -1 if text is invalid or would not fit in maxSize
+inline int decodeBase64(const char *text, uint8_t *data, uint32_t maxSize) {
+  uint32_t size = 0;
+  uint32_t bits = 0;
+  int nbBits = 0;
+  for (; *text != '\0' && *text != '='; text++) {
+    if (*text == ' ' || *text == '\n' || *text == '\r' || *text == '\t') {
+      continue;
+    }
+    const int value = base64Value(*text);
+    if (value < 0) {
+      return -1;
+    }
+    bits = (bits << 6) | value;
+    nbBits += 6;
+    if (nbBits >= 8) {
+      nbBits -= 8;
+      if (size >= maxSize) {
+        return -1;
+      }
+      data[size++] = bits >> nbBits;
+    }
+  }
+  return size;
+}
+
+// Latest value from one thread to another, without lock nor waiting on either side.
+// Writer fills back() then publishes it, reader fetches the latest one published, three buffers rotating in-between.
+template <typename T>
+class TripleBuffer {
+
+ public:
+  // writer side: buffer to fill, previous content is stale
+  T &back() {
+    return buffers[backIdx];
+  }
+
+  // writer side: back buffer becomes the latest one, writer gets another one
+  void publish() {
+    backIdx = middle.exchange(backIdx | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  // reader side: latest buffer if one was published since last call, nullptr otherwise
+  const T *fetch() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+      return nullptr;
+    }
+    frontIdx = middle.exchange(frontIdx, std::memory_order_acq_rel) & INDEX;
+    return &buffers[frontIdx];
+  }
+
+  // reader side: last buffer fetched, only valid if something was published before
+  const T &front() const {
+    return buffers[frontIdx];
+  }
+
+ private:
+  static const uint8_t INDEX = 3;
+  static const uint8_t FRESH = 4;
+  T buffers[3];
+  uint8_t backIdx = 0;
+  std::atomic<uint8_t> middle{1};
+  uint8_t frontIdx = 2;
+};
+
+#endif /* SIMON_STATE_H */
@@ -0,0 +1,278 @@
+
+#ifndef SIMON_SYNTH_H
+#define SIMON_SYNTH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "SimonSimd.h"
+
+// voices of the pool, by groups of 4 -- a voice per note and channel, the quietest one is stolen beyond
+#define SYNTH_MAX_VOICES 32
+#define SYNTH_NB_GROUPS (SYNTH_MAX_VOICES / 4)
+// in seconds: ramp at note on against clicks, and time to fade by 60 dB once released (damper)
+#define SYNTH_ATTACK 0.002f
+#define SYNTH_RELEASE 0.15f
+// in seconds, time to fade by 60 dB while held: long for the lowest note of a piano, short for the highest
+#define SYNTH_SUSTAIN_LOW 8.0f
+#define SYNTH_SUSTAIN_HIGH 0.8f
+// level of the stretched second partial, on top of the FM pair
+#define SYNTH_PARTIAL 0.2f
+#define SYNTH_STRETCH 2.0015f
+// a voice below that (-80 dB) is free again
+#define SYNTH_SILENCE 0.0001f
+// level of one voice at full velocity, room for a few voices before clipping
+#define SYNTH_VOICE_GAIN 0.25f
+// phases are wrapped every that many frames, to keep precision within a long block
+#define SYNTH_WRAP_FRAMES 64
+
+// sin(2 pi x) for a phase x in cycles, any value: parabola refined once, error about 0.1%
+inline Float4 f4Sine(Float4 x) {
+  x = f4Sub(x, f4Floor(f4Add(x, f4Set(0.5f))));
+  const Float4 y = f4Mul(f4Mul(f4Set(8.0f), x), f4Sub(f4Set(1.0f), f4Mul(f4Set(2.0f), f4Abs(x))));
+  return f4Add(y, f4Mul(f4Set(0.225f), f4Sub(f4Mul(y, f4Abs(y)), y)));
+}
+
+// Small piano-like synth: each voice is a carrier phase-modulated by itself (brightness fading faster than the note) plus a slightly sharp second partial.
+// Voices are preallocated and laid out by field, rendered 4 at a time. Notes are given with their frame in the block, rendering catches up before each one.
+class Synth {
+
+ public:
+  Synth() {
+    reset();
+  }
+
+  // every voice is cut, e.g. upon new sample rate
+  void setSampleRate(double newSampleRate) {
+    sampleRate = newSampleRate > 0 ? newSampleRate : 48000;
+    reset();
+  }
+
+  // dB, applied along next block
+  void setVolume(float volume) {
+    targetGain = powf(10.0f, volume / 20);
+  }
+
+  // silence right away
+  void reset() {
+    for (int v = 0; v < SYNTH_MAX_VOICES; v++) {
+      active[v] = false;
+      released[v] = false;
+      amp[v] = 0;
+      phase[v] = phase2[v] = inc[v] = inc2[v] = 0;
+      index[v] = attack[v] = 0;
+      decay[v] = indexDecay[v] = 1;
+      attackStep[v] = 0;
+    }
+  }
+
+  // a block starts, out is filled along, see advance(), until endBlock()
+  void beginBlock(float *newOut, uint32_t nbFrames) {
+    out = newOut;
+    blockFrames = nbFrames;
+    rendered = 0;
+    silent = true;
+  }
+
+  // render what is before this frame of the block, next event happens there
+  void advance(uint32_t frame) {
+    if (out == nullptr) {
+      return;
+    }
+    if (frame > blockFrames) {
+      frame = blockFrames;
+    }
+    if (frame > rendered) {
+      render(out + rendered, frame - rendered);
+      rendered = frame;
+    }
+  }
+
+  // rest of the block, volume changes are ramped over it
+  // return false if the block is only silence
+  bool endBlock() {
+    advance(blockFrames);
+    const bool sounding = out != nullptr && !silent;
+    if (sounding) {
+      const float step = blockFrames > 0 ? (targetGain - gain) / blockFrames : 0;
+      for (uint32_t i = 0; i < blockFrames; i++) {
+        out[i] *= gain + step * (i + 1);
+      }
+    }
+    gain = targetGain;
+    out = nullptr;
+    return sounding;
+  }
+
+  // same note on the same channel strikes its voice again
+  void noteOn(uint8_t note, uint8_t velocity, uint8_t channel, uint32_t frame) {
+    advance(frame);
+    if (velocity == 0) {
+      noteOff(note, channel, frame);
+      return;
+    }
+    const int v = findVoice(note, channel);
+    const float key = (note - 21) / 87.0f;
+    const float keyTrack = key < 0 ? 0 : key > 1 ? 1 : key;
+    const float level = velocity / 127.0f;
+    const float sustain = SYNTH_SUSTAIN_LOW * powf(SYNTH_SUSTAIN_HIGH / SYNTH_SUSTAIN_LOW, keyTrack);
+    active[v] = true;
+    released[v] = false;
+    notes[v] = note;
+    channels[v] = channel;
+    phase[v] = 0;
+    phase2[v] = 0;
+    inc[v] = 440.0f * powf(2.0f, (note - 69) / 12.0f) / sampleRate;
+    inc2[v] = inc[v] * SYNTH_STRETCH;
+    // modulation in cycles, brighter when hit harder and in the bass
+    index[v] = 0.02f + 0.25f * level * (1 - 0.7f * keyTrack);
+    indexDecay[v] = fadeRate(sustain / 4);
+    amp[v] = SYNTH_VOICE_GAIN * level;
+    decay[v] = fadeRate(sustain);
+    attack[v] = 1;
+    attackStep[v] = 1.0f / (SYNTH_ATTACK * sampleRate);
+  }
+
+  // dampers down on this note
+  void noteOff(uint8_t note, uint8_t channel, uint32_t frame) {
+    advance(frame);
+    for (int v = 0; v < SYNTH_MAX_VOICES; v++) {
+      if (active[v] && !released[v] && notes[v] == note && channels[v] == channel) {
+        release(v);
+      }
+    }
+  }
+
+  // every voice fades out
+  void releaseAll() {
+    for (int v = 0; v < SYNTH_MAX_VOICES; v++) {
+      if (active[v] && !released[v]) {
+        release(v);
+      }
+    }
+  }
+
+  // voices still sounding
+  int nbActive() const {
+    int nb = 0;
+    for (int v = 0; v < SYNTH_MAX_VOICES; v++) {
+      nb += active[v];
+    }
+    return nb;
+  }
+
+ private:
+  double sampleRate = 48000;
+  // current block
+  float *out = nullptr;
+  uint32_t blockFrames = 0;
+  uint32_t rendered = 0;
+  // no voice so far in the block
+  bool silent = true;
+  // linear, ramping to target
+  float gain = 1;
+  float targetGain = 1;
+
+  // by field, what is rendered: phases in cycles, increments per frame, levels and their factor per frame
+  // note: levels decay toward 0 but never get that low (denormals), voices are freed before and attack is linear
+  alignas(16) float phase[SYNTH_MAX_VOICES];
+  alignas(16) float inc[SYNTH_MAX_VOICES];
+  alignas(16) float phase2[SYNTH_MAX_VOICES];
+  alignas(16) float inc2[SYNTH_MAX_VOICES];
+  alignas(16) float index[SYNTH_MAX_VOICES];
+  alignas(16) float indexDecay[SYNTH_MAX_VOICES];
+  alignas(16) float amp[SYNTH_MAX_VOICES];
+  alignas(16) float decay[SYNTH_MAX_VOICES];
+  alignas(16) float attack[SYNTH_MAX_VOICES];
+  alignas(16) float attackStep[SYNTH_MAX_VOICES];
+  // bookkeeping
+  bool active[SYNTH_MAX_VOICES];
+  bool released[SYNTH_MAX_VOICES];
+  uint8_t notes[SYNTH_MAX_VOICES];
+  uint8_t channels[SYNTH_MAX_VOICES];
+
+  // factor per frame to fade by 60 dB in that many seconds
+  float fadeRate(float seconds) const {
+    return expf(-6.9078f / (seconds * sampleRate));
+  }
+
+  void release(int v) {
+    released[v] = true;
+    decay[v] = fadeRate(SYNTH_RELEASE);
+  }
+
+  // voice of this note if sounding, otherwise the first free one -- keeps active voices in few groups -- otherwise the quietest
+  int findVoice(uint8_t note, uint8_t channel) const {
+    for (int v = 0; v < SYNTH_MAX_VOICES; v++) {
+      if (active[v] && notes[v] == note && channels[v] == channel) {
+        return v;
+      }
+    }
+    for (int v = 0; v < SYNTH_MAX_VOICES; v++) {
+      if (!active[v]) {
+        return v;
+      }
+    }
+    int quietest = 0;
+    for (int v = 1; v < SYNTH_MAX_VOICES; v++) {
+      if (amp[v] < amp[quietest]) {
+        quietest = v;
+      }
+    }
+    return quietest;
+  }
+
+  // mix of all voices to dest, groups without any voice are skipped
+  void render(float *dest, uint32_t nbFrames) {
+    memset(dest, 0, nbFrames * sizeof(float));
+    for (int g = 0; g < SYNTH_NB_GROUPS; g++) {
+      const int v = g * 4;
+      if (!(active[v] || active[v + 1] || active[v + 2] || active[v + 3])) {
+        continue;
+      }
+      silent = false;
+      Float4 p = f4Load(phase + v);
+      Float4 p2 = f4Load(phase2 + v);
+      Float4 idx = f4Load(index + v);
+      Float4 a = f4Load(amp + v);
+      Float4 att = f4Load(attack + v);
+      const Float4 dp = f4Load(inc + v);
+      const Float4 dp2 = f4Load(inc2 + v);
+      const Float4 idxDecay = f4Load(indexDecay + v);
+      const Float4 aDecay = f4Load(decay + v);
+      const Float4 attStep = f4Load(attackStep + v);
+      const Float4 zero = f4Set(0);
+      const Float4 partial = f4Set(SYNTH_PARTIAL);
+      for (uint32_t start = 0; start < nbFrames; start += SYNTH_WRAP_FRAMES) {
+        const uint32_t end = start + SYNTH_WRAP_FRAMES < nbFrames ? start + SYNTH_WRAP_FRAMES : nbFrames;
+        for (uint32_t i = start; i < end; i++) {
+          const Float4 fm = f4Sine(f4Add(p, f4Mul(idx, f4Sine(p))));
+          const Float4 s = f4Add(fm, f4Mul(partial, f4Sine(p2)));
+          dest[i] += f4Sum(f4Mul(s, f4Sub(a, f4Mul(a, att))));
+          p = f4Add(p, dp);
+          p2 = f4Add(p2, dp2);
+          idx = f4Mul(idx, idxDecay);
+          a = f4Mul(a, aDecay);
+          att = f4Max(f4Sub(att, attStep), zero);
+        }
+        p = f4Sub(p, f4Floor(p));
+        p2 = f4Sub(p2, f4Floor(p2));
+      }
+      f4Store(phase + v, p);
+      f4Store(phase2 + v, p2);
+      f4Store(index + v, idx);
+      f4Store(amp + v, a);
+      f4Store(attack + v, att);
+    }
+    // faded out, free again
+    for (int v = 0; v < SYNTH_MAX_VOICES; v++) {
+      if (active[v] && amp[v] < SYNTH_SILENCE) {
+        active[v] = false;
+        amp[v] = 0;
+        index[v] = 0;
+      }
+    }
+  }
+};
+
+#endif /* SIMON_SYNTH_H */
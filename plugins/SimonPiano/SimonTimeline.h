@@ -0,0 +1,109 @@
+
+#ifndef SIMON_TIMELINE_H
+#define SIMON_TIMELINE_H
+
+#include <stdint.h>
+#include "SimonUtils.h"
+
+// what to do once the frame of an entry is reached
+enum TimelineAction {
+  TL_NEW_ROUND, // end of the pause before the first round
+  TL_INSTRUCTION_ON, // play next note of the sequence
+  TL_INSTRUCTION_OFF, // release current note of the sequence
+  TL_PLAYER_TURN, // instructions are over
+  TL_FEEDBACK_ON, // play a note for a feedback
+  TL_FEEDBACK_OFF, // release a note for a feedback
+  TL_INCORRECT_DONE, // end of feedback after a miss
+  TL_LOST_DONE, // end of feedback once the game is lost
+};
+
+// one action scheduled at an absolute frame
+struct TimelineEntry {
+  uint64_t frame;
+  uint8_t action;
+  uint8_t note;
+};
+
+// a whole round of instructions up to MAX_ROUND (note on and off for each step, then player's turn), longer endless rounds are compiled by chunks
+// must be a power of 2
+#define TIMELINE_SIZE 512
+
+// Deadlines of the current phase of the game, compiled when the phase starts: whole round of instructions, or feedback.
+// Entries are appended in chronological order and consumed in the same order, no sorting needed. Circular, so that more can be appended as entries are consumed.
+class Timeline {
+
+ public:
+  // discard all entries, before compiling a new phase starting at origin
+  void clear(uint64_t origin = 0) {
+    head = 0;
+    tail = 0;
+    last = origin;
+  }
+
+  // append an entry, frame should not be before the last one
+  // return false if full
+  bool push(uint64_t frame, uint8_t action, uint8_t note = 0) {
+    if (tail - head >= TIMELINE_SIZE) {
+      return false;
+    }
+    TimelineEntry &entry = entries[tail & (TIMELINE_SIZE - 1)];
+    entry.frame = frame;
+    entry.action = action;
+    entry.note = note;
+    tail++;
+    last = frame;
+    return true;
+  }
+
+  // pop next entry if it is due before end (excluded)
+  // note: entry is copied since the timeline could be compiled again while dispatching it
+  bool pop(uint64_t end, TimelineEntry &entry) {
+    if (head == tail || entries[head & (TIMELINE_SIZE - 1)].frame >= end) {
+      return false;
+    }
+    entry = entries[head & (TIMELINE_SIZE - 1)];
+    head++;
+    return true;
+  }
+
+  // frame of next entry, return false if there is none left
+  bool peek(uint64_t &frame) const {
+    if (head == tail) {
+      return false;
+    }
+    frame = entries[head & (TIMELINE_SIZE - 1)].frame;
+    return true;
+  }
+
+  // room for that many entries
+  uint32_t getFree() const {
+    return TIMELINE_SIZE - (tail - head);
+  }
+
+  // frame of the last entry appended, origin of the phase if none, where to compile from
+  uint64_t getLast() const {
+    return last;
+  }
+
+  // scale the distance between origin and the entries not consumed yet, e.g. when sample rate changes
+  void rescale(uint64_t origin, double ratio) {
+    for (uint32_t i = head; i != tail; i++) {
+      uint64_t &frame = entries[i & (TIMELINE_SIZE - 1)].frame;
+      if (frame > origin) {
+        frame = origin + (uint64_t) ((frame - origin) * ratio + 0.5);
+      }
+    }
+    if (last > origin) {
+      last = origin + (uint64_t) ((last - origin) * ratio + 0.5);
+    }
+  }
+
+ private:
+  TimelineEntry entries[TIMELINE_SIZE];
+  // next entry to be consumed and next one to be appended, wrapped upon access
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  uint64_t last = 0;
+};
+
+#endif /* SIMON_TIMELINE_H */
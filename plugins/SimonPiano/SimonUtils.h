@@ -4,9 +4,72 @@
 
 // sync parameters' list the declared number of parameters
 #include "DistrhoPluginInfo.h"
+#include <stdint.h>
 
-// does not seem feasible to go there
+// does not seem feasible to go there... except in endless mode
 #define MAX_ROUND 128
+// endless mode stops there, counters must be exact as float parameters
+#define MAX_ENDLESS_ROUND 16777215
+
+// default time between notes for instructions (and before first instruction), and how long each note is held, in ms
+#define NOTE_INTERVAL 250
+#define NOTE_DURATION 500
+
+// melody from a MIDI file: key of the state holding its path, tracks that can be picked, and notes kept per track -- a melody longer than that is cut
+#define MELODY_KEY "melody"
+#define MELODY_MAX_TRACKS 16
+#define MELODY_MAX_NOTES 1024
+
+// built-in synth on by default where there is no other instrument at hand, i.e. on the web
+#if defined(DISTRHO_OS_WASM)
+#define SYNTH_DEFAULT 1
+#else
+#define SYNTH_DEFAULT 0
+#endif
+
+// synth settings are only exposed along audio outputs, i.e. in the audio variant
+#if DISTRHO_PLUGIN_NUM_OUTPUTS > 0
+#define SYNTH_HINTS kParameterIsAutomatable
+#else
+#define SYNTH_HINTS kParameterIsHidden
+#endif
+// same for pitch detection along an audio input
+#if DISTRHO_PLUGIN_NUM_INPUTS > 0
+#define AUDIO_INPUT_HINTS kParameterIsAutomatable
+#else
+#define AUDIO_INPUT_HINTS kParameterIsHidden
+#endif
+
+// how instructions speed up from first to last round
+enum Curve {
+            CURVE_FLAT, // same speed all along
+            CURVE_LINEAR,
+            CURVE_EXPONENTIAL,
+            CURVE_STEPPED, // linear by steps of CURVE_STEP_ROUNDS
+
+            CURVE_COUNT
+};
+#define CURVE_STEP_ROUNDS 16
+
+// how new notes are drawn among the ones in use
+enum Generator {
+                GEN_UNIFORM, // any note, independently of the previous one
+                GEN_MELODIC, // from the previous note, favoring small intervals and strong degrees, see SimonGenerator.h
+
+                GENERATOR_COUNT
+};
+
+// kinds of incoming MIDI messages, besides notes, forwarded to the output
+enum PassThrough {
+                  PASS_CONTROL = 1, // control change, e.g. sustain pedal
+                  PASS_PROGRAM = 2,
+                  PASS_BEND = 4,
+                  PASS_CHANNEL_PRESSURE = 8,
+                  PASS_POLY_PRESSURE = 16,
+                  PASS_SYSTEM = 32, // sysex and the rest
+
+                  PASS_ALL = 63
+};
 
 enum Status {
                 WAITING,
@@ -31,76 +94,221 @@ inline bool isPlaying(int status) {
     return (status == PLAYING_WAIT || status == PLAYING_CORRECT || status == PLAYING_INCORRECT);
 }
 
-// sharing parameters info across DSP and UI.
-const ParameterRanges params[kParameterCount] =
-    {
-     // default, min, max.
-     ParameterRanges(0, 0, 1), // start
-     ParameterRanges(60, 0, 127), // root
-     ParameterRanges(12, 1, 128), // number of notes
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(0, 0, 1), // shall not pass
-     ParameterRanges(1, 0, MAX_ROUND), // rounds for miss
-     ParameterRanges(60, 0, 127), // effective root
-     ParameterRanges(12, 1, 128), // effective number of notes
-     ParameterRanges(WAITING, 0, STATUS_COUNT), // status
-     ParameterRanges(-1, -1, 127), // current active note
-     ParameterRanges(0, 0, MAX_ROUND), // current round
-     ParameterRanges(0, 0, MAX_ROUND), // current step number
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(1, 0, 1), // scale
-     ParameterRanges(0, 0, MAX_ROUND), // current nb miss
-     ParameterRanges(0, 0, MAX_ROUND), // max miss possible
-     ParameterRanges(0, 0, MAX_ROUND), // max round completed
-    };
+// everything about a parameter, sharing info across DSP and UI.
+struct ParameterInfo {
+  // position in Parameters, to check the table at compile time
+  uint32_t index;
+  uint32_t hints;
+  const char *name;
+  const char *shortName;
+  const char *symbol;
+  const char *unit;
+  float def;
+  float min;
+  float max;
+};
+
+// outputs of each lane in multi-player
+enum LaneOutput {
+                 LANE_STATUS,
+                 LANE_ROUND,
+                 LANE_MISS,
+};
+static_assert(LANE_MISS + 1 == LANE_NB_OUTPUTS, "number of outputs per lane");
+
+// index of an output for this lane
+constexpr uint32_t laneParameter(int lane, int output) {
+  return kLaneOutputs + lane * LANE_NB_OUTPUTS + output;
+}
+
+// entries of the outputs of one lane, n being its number for humans, from 1
+#define LANE_PARAMS(i, n) \
+  {laneParameter(i, LANE_STATUS), kParameterIsInteger|kParameterIsOutput, "Player " #n " status", "status " #n, "player" #n "status", "", WAITING, 0, STATUS_COUNT - 1}, \
+  {laneParameter(i, LANE_ROUND), kParameterIsInteger|kParameterIsOutput, "Player " #n " round", "round " #n, "player" #n "round", "round", 0, 0, MAX_ENDLESS_ROUND}, \
+  {laneParameter(i, LANE_MISS), kParameterIsInteger|kParameterIsOutput, "Player " #n " miss", "miss " #n, "player" #n "miss", "miss", 0, 0, MAX_ENDLESS_ROUND}
+
+constexpr ParameterInfo params[] = {
+  // index, hints, name, short name, symbol, unit, default, min, max
+  // must go from false to true during WAITING state to take effect
+  {kStart, kParameterIsAutomatable|kParameterIsBoolean, "Start new round", "start", "start", "", 0, 0, 1},
+  {kRoot, kParameterIsInteger|kParameterIsAutomatable, "Output root note", "root", "rootnote", "", 60, 0, 127},
+  {kNbNotes, kParameterIsInteger|kParameterIsAutomatable, "Number of notes", "nb notes", "nbnotes", "notes", 12, 1, 128},
+  // toggle for each note of the scale
+  {kScaleC, kParameterIsAutomatable|kParameterIsBoolean, "C", "C", "C", "", 1, 0, 1},
+  {kScaleCs, kParameterIsAutomatable|kParameterIsBoolean, "C#", "C#", "Cs", "", 1, 0, 1},
+  {kScaleD, kParameterIsAutomatable|kParameterIsBoolean, "D", "D", "D", "", 1, 0, 1},
+  {kScaleDs, kParameterIsAutomatable|kParameterIsBoolean, "D#", "D#", "Ds", "", 1, 0, 1},
+  {kScaleE, kParameterIsAutomatable|kParameterIsBoolean, "E", "E", "E", "", 1, 0, 1},
+  {kScaleF, kParameterIsAutomatable|kParameterIsBoolean, "F", "F", "F", "", 1, 0, 1},
+  {kScaleFs, kParameterIsAutomatable|kParameterIsBoolean, "F#", "F#", "Fs", "", 1, 0, 1},
+  {kScaleG, kParameterIsAutomatable|kParameterIsBoolean, "G", "G", "G", "", 1, 0, 1},
+  {kScaleGs, kParameterIsAutomatable|kParameterIsBoolean, "G#", "G#", "Gs", "", 1, 0, 1},
+  {kScaleA, kParameterIsAutomatable|kParameterIsBoolean, "A", "A", "A", "", 1, 0, 1},
+  {kScaleAs, kParameterIsAutomatable|kParameterIsBoolean, "A#", "A#", "As", "", 1, 0, 1},
+  {kScaleB, kParameterIsAutomatable|kParameterIsBoolean, "B", "B", "B", "", 1, 0, 1},
+  // notes outside scale are not take into account
+  {kShallNotPass, kParameterIsAutomatable|kParameterIsBoolean, "Shall not pass", "no pass", "shallnotpass", "", 0, 0, 1},
+  // how many rounds to grant a new miss. 0 to disable.
+  {kRoundsForMiss, kParameterIsInteger|kParameterIsAutomatable, "Rounds to grant a miss", "rnd f mis", "roundsformiss", "rounds", 1, 0, MAX_ROUND},
+  {kEffectiveRoot, kParameterIsInteger|kParameterIsOutput, "Effective root", "eff root", "effectiveroot", "", 60, 0, 127},
+  {kEffectiveNbNotes, kParameterIsInteger|kParameterIsOutput, "Effective number of notes", "eff nbnotes", "effectivenbroot", "notes", 12, 1, 128},
+  // used to pass to UI what general status and current note is about
+  {kStatus, kParameterIsInteger|kParameterIsOutput, "Status", "stat", "status", "", WAITING, 0, STATUS_COUNT},
+  {kCurNote, kParameterIsInteger|kParameterIsOutput, "Current active note", "note", "curnote", "", -1, -1, 127},
+  {kRound, kParameterIsInteger|kParameterIsOutput, "Round number", "round", "round", "round", 0, 0, MAX_ENDLESS_ROUND},
+  {kStep, kParameterIsInteger|kParameterIsOutput, "Step number", "step", "step", "step", 0, 0, MAX_ENDLESS_ROUND},
+  {kEffectiveScaleC, kParameterIsBoolean|kParameterIsOutput, "Effective C", "eff C", "effectiveC", "", 1, 0, 1},
+  {kEffectiveScaleCs, kParameterIsBoolean|kParameterIsOutput, "Effective C#", "eff C#", "effectiveCs", "", 1, 0, 1},
+  {kEffectiveScaleD, kParameterIsBoolean|kParameterIsOutput, "Effective D", "eff D", "effectiveD", "", 1, 0, 1},
+  {kEffectiveScaleDs, kParameterIsBoolean|kParameterIsOutput, "Effective D#", "eff D#", "effectiveDs", "", 1, 0, 1},
+  {kEffectiveScaleE, kParameterIsBoolean|kParameterIsOutput, "Effective E", "eff E", "effectiveE", "", 1, 0, 1},
+  {kEffectiveScaleF, kParameterIsBoolean|kParameterIsOutput, "Effective F", "eff F", "effectiveF", "", 1, 0, 1},
+  {kEffectiveScaleFs, kParameterIsBoolean|kParameterIsOutput, "Effective F#", "eff F#", "effectiveFs", "", 1, 0, 1},
+  {kEffectiveScaleG, kParameterIsBoolean|kParameterIsOutput, "Effective G", "eff G", "effectiveG", "", 1, 0, 1},
+  {kEffectiveScaleGs, kParameterIsBoolean|kParameterIsOutput, "Effective G#", "eff G#", "effectiveGs", "", 1, 0, 1},
+  {kEffectiveScaleA, kParameterIsBoolean|kParameterIsOutput, "Effective A", "eff A", "effectiveA", "", 1, 0, 1},
+  {kEffectiveScaleAs, kParameterIsBoolean|kParameterIsOutput, "Effective A#", "eff A#", "effectiveAs", "", 1, 0, 1},
+  {kEffectiveScaleB, kParameterIsBoolean|kParameterIsOutput, "Effective B", "eff B", "effectiveB", "", 1, 0, 1},
+  {kNbMiss, kParameterIsInteger|kParameterIsOutput, "Number of miss", "nb miss", "nbmiss", "miss", 0, 0, MAX_ENDLESS_ROUND},
+  {kMaxMiss, kParameterIsInteger|kParameterIsOutput, "Max number of miss", "max miss", "maxmiss", "miss", 0, 0, MAX_ENDLESS_ROUND},
+  {kMaxRound, kParameterIsInteger|kParameterIsOutput, "Max round reached", "max round", "maxround", "rounds", 0, 0, MAX_ENDLESS_ROUND},
+  // used by UI to find the events of this instance, 0 if none. Must be exact as float.
+  {kEventStream, kParameterIsInteger|kParameterIsOutput, "Event stream", "events", "eventstream", "", 0, 0, 16777215},
+  // same seed, same game. 0 for a different game each time. Must be exact as float.
+  {kSeed, kParameterIsInteger|kParameterIsAutomatable, "Seed", "seed", "seed", "", 0, 0, 16777215},
+  // draw all notes upon new game instead of each round
+  {kPregenerate, kParameterIsAutomatable|kParameterIsBoolean, "Pregenerate sequence", "pregen", "pregenerate", "", 0, 0, 1},
+  // keep on after MAX_ROUND
+  {kEndless, kParameterIsAutomatable|kParameterIsBoolean, "Endless mode", "endless", "endless", "", 0, 0, 1},
+  // ignore a note on coming too soon after the previous one for the same note, e.g. double triggers of some controllers. 0 to disable.
+  {kDebounce, kParameterIsInteger|kParameterIsAutomatable, "Debounce", "debounce", "debounce", "ms", 0, 0, 100},
+  {kFiltered, kParameterIsInteger|kParameterIsOutput, "Notes filtered by debounce", "filtered", "filtered", "notes", 0, 0, 16777215},
+  // instructions on the beats of the host, when its transport is rolling
+  {kTempoSync, kParameterIsAutomatable|kParameterIsBoolean, "Sync to host tempo", "sync", "temposync", "", 0, 0, 1},
+  {kInterval, kParameterIsInteger|kParameterIsAutomatable, "Instruction interval", "interval", "interval", "ms", NOTE_INTERVAL, 20, 2000},
+  {kDuration, kParameterIsInteger|kParameterIsAutomatable, "Instruction duration", "duration", "duration", "ms", NOTE_DURATION, 20, 2000},
+  // one of Curve
+  {kCurve, kParameterIsInteger|kParameterIsAutomatable, "Difficulty curve", "curve", "curve", "", CURVE_FLAT, 0, CURVE_COUNT - 1},
+  // how much faster instructions are at MAX_ROUND compared to first round, unless flat curve
+  {kSpeedUp, kParameterIsInteger|kParameterIsAutomatable, "Speed-up at last round", "speed-up", "speedup", "%", 100, 0, 400},
+  {kTempo, kParameterIsInteger|kParameterIsOutput, "Instruction tempo", "tempo", "tempo", "BPM", 80, 0, 6000},
+  // time between two notes of the player compared to the same notes during instructions
+  {kTolerance, kParameterIsInteger|kParameterIsAutomatable, "Rhythm tolerance", "rhythm", "tolerance", "ms", 0, 0, 1000},
+  {kTimingMean, kParameterIsInteger|kParameterIsOutput, "Timing error mean", "t mean", "timingmean", "ms", 0, -10000, 10000},
+  {kTimingJitter, kParameterIsInteger|kParameterIsOutput, "Timing error jitter", "t jitter", "timingjitter", "ms", 0, 0, 10000},
+  // combination of PassThrough
+  {kPassThrough, kParameterIsInteger|kParameterIsAutomatable, "Pass-through", "pass", "passthrough", "", PASS_ALL, 0, PASS_ALL},
+  // lane i listens to channel i and plays instructions on it, with 1 everything goes to the first lane as in single player
+  {kLanes, kParameterIsInteger|kParameterIsAutomatable, "Number of players", "players", "players", "", 1, 1, MAX_LANES},
+  // notes of the loaded melody one round after the other, root, number of notes and scale follow its range
+  {kMelody, kParameterIsAutomatable|kParameterIsBoolean, "Learn melody", "melody", "melody", "", 0, 0, 1},
+  // 0: highest note across tracks, otherwise highest note of this track
+  {kMelodyTrack, kParameterIsInteger|kParameterIsAutomatable, "Melody track", "track", "melodytrack", "", 0, 0, MELODY_MAX_TRACKS},
+  // 0 if no melody is in use
+  {kMelodyLength, kParameterIsInteger|kParameterIsOutput, "Melody length", "length", "melodylength", "notes", 0, 0, MELODY_MAX_NOTES},
+  // one of Generator, the options below only apply to the melodic one
+  {kGenerator, kParameterIsInteger|kParameterIsAutomatable, "Generator", "generator", "generator", "", GEN_UNIFORM, 0, GENERATOR_COUNT - 1},
+  // largest interval between two consecutive notes
+  {kMaxLeap, kParameterIsInteger|kParameterIsAutomatable, "Max leap", "max leap", "maxleap", "semitones", 12, 1, 24},
+  {kNoRepeat, kParameterIsAutomatable|kParameterIsBoolean, "No immediate repeat", "no repeat", "norepeat", "", 1, 0, 1},
+  // 0: any interval within max leap equally likely, the higher the more small intervals dominate
+  {kStepwise, kParameterIsInteger|kParameterIsAutomatable, "Stepwise motion", "stepwise", "stepwise", "%", 50, 0, 100},
+  // 0: every degree equally likely, the higher the more root, fifth and third (from root) dominate
+  {kTonality, kParameterIsInteger|kParameterIsAutomatable, "Tonal gravity", "tonal", "tonality", "%", 50, 0, 100},
+  // notes we send are also played to the audio outputs, MIDI output is unchanged
+  {kSynth, SYNTH_HINTS|kParameterIsBoolean, "Built-in synth", "synth", "synth", "", SYNTH_DEFAULT, 0, 1},
+  {kSynthVolume, kParameterIsInteger|SYNTH_HINTS, "Synth volume", "volume", "synthvolume", "dB", -6, -40, 0},
+  // monophonic pitch tracking of the audio input, e.g. acoustic piano and microphone, in place of or along MIDI input
+  {kAudioInput, AUDIO_INPUT_HINTS|kParameterIsBoolean, "Audio input", "audio in", "audioinput", "", 0, 0, 1},
+  // time between two analyses: lower for less latency, higher for less CPU
+  {kAudioHop, kParameterIsInteger|AUDIO_INPUT_HINTS, "Detection hop", "hop", "audiohop", "ms", 5, 1, 40},
+  // input level below which nothing is detected
+  {kAudioGate, kParameterIsInteger|AUDIO_INPUT_HINTS, "Input gate", "gate", "audiogate", "dB", -40, -80, 0},
+  // markers for the UI, never applied as such
+  {kParameterGroup, kParameterIsBoolean|kParameterIsHidden, "Parameter group", "group", "parametergroup", "", 0, 0, 1},
+  LANE_PARAMS(0, 1),
+  LANE_PARAMS(1, 2),
+  LANE_PARAMS(2, 3),
+  LANE_PARAMS(3, 4),
+  LANE_PARAMS(4, 5),
+  LANE_PARAMS(5, 6),
+  LANE_PARAMS(6, 7),
+  LANE_PARAMS(7, 8),
+  LANE_PARAMS(8, 9),
+  LANE_PARAMS(9, 10),
+  LANE_PARAMS(10, 11),
+  LANE_PARAMS(11, 12),
+  LANE_PARAMS(12, 13),
+  LANE_PARAMS(13, 14),
+  LANE_PARAMS(14, 15),
+  LANE_PARAMS(15, 16),
+};
+
+// the table must list all parameters, in order
+constexpr bool paramsInOrder(uint32_t i = 0) {
+  return i >= kParameterCount || (params[i].index == i && paramsInOrder(i + 1));
+}
+static_assert(sizeof(params) / sizeof(params[0]) == kParameterCount, "one entry per parameter");
+static_assert(paramsInOrder(), "entries in the same order as Parameters");
+// DSP and UI access scales by offset
+static_assert(kScaleB - kScaleC == 11 && kEffectiveScaleB - kEffectiveScaleC == 11, "scale parameters must be consecutive");
+
+// input parameters can be changed by host and UI, outputs by DSP only
+constexpr bool isParameterOutput(uint32_t index) {
+  return params[index].hints & kParameterIsOutput;
+}
 
 // names for notes
 static const char* const scaleNotes[12] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
-// tune for illegal symbols
-static const char* const scaleNotesSymbols[12] = {"C", "Cs", "D", "Ds", "E", "F", "Fs", "G", "Gs", "A", "As", "B"};
 
-// implementing our own rand/srand following basic example from their man page, so as to have a separate sequence
+// our own number generator, so as to have a separate sequence that only depends on the seed
+// PCG32 (XSH RR variant, see pcg-random.org): 64 bits of state, same sequence on every platform
 class Rando {
 
-  // we will not generate numbers beyond that
-  const int RANDO_MAX = 32767; 
-
  public:
-  /* RAND_MAX assumed to be 32767 */
-  int rand(void) {
-    next = next * 1103515245 + 12345;
-    return((unsigned)(next/65536) % (RANDO_MAX+1));
+  // same seed, same sequence
+  void srand(uint64_t seed) {
+    state = 0;
+    next();
+    state += seed;
+    next();
+  }
+
+  // uniform over 32 bits
+  uint32_t next() {
+    const uint64_t old = state;
+    state = old * 6364136223846793005ULL + increment;
+    const uint32_t xorShifted = ((old >> 18) ^ old) >> 27;
+    const uint32_t rot = old >> 59;
+    return (xorShifted >> rot) | (xorShifted << ((-rot) & 31));
+  }
+
+  // uniform in [0, range), without modulo bias (Lemire's multiply and reject, a division only in rare cases)
+  uint32_t bounded(uint32_t range) {
+    uint64_t m = (uint64_t) next() * range;
+    uint32_t low = (uint32_t) m;
+    if (low < range) {
+      const uint32_t threshold = -range % range;
+      while (low < threshold) {
+        m = (uint64_t) next() * range;
+        low = (uint32_t) m;
+      }
+    }
+    return m >> 32;
   }
 
-  // c
-  void srand(unsigned int seed) {
-    next = seed;
+  // whole state, to go on later on with the same sequence
+  uint64_t getState() const {
+    return state;
+  }
+  void setState(uint64_t newState) {
+    state = newState;
   }
 
  private:
-  unsigned long next = 1;
-  
+  // any odd number selects the stream
+  static const uint64_t increment = 1442695040888963407ULL;
+  uint64_t state = 0x853c49e6748fea9bULL;
 };
 
 // dealing with pseudo-presets in the ui
@@ -130,7 +338,7 @@ const Preset presets[NB_PRESETS] = {
 };
 
 // return -1 if the preset cannot be found
-inline int getPresetIdx(int root, int nbNotes, bool scale[12]) {
+inline int getPresetIdx(int root, int nbNotes, const int scale[12]) {
   int i;
   for (i=0; i < NB_PRESETS; i++) {
     if ((presets[i].root >= 0 && root != presets[i].root) ||